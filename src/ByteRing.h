@@ -0,0 +1,140 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+#ifndef CCSNIFFER_BYTERING_H
+#define CCSNIFFER_BYTERING_H
+
+#include <stdint.h>
+#include "SpscRing.h"
+
+/*
+ * Lock free single producer / single consumer ring of variable length records.
+ *
+ * The buffer is split in GRANULES blocks of GRANULE_SIZE bytes; each record is a 4 bytes header
+ * (the record length) followed by the data, and always occupies a contiguous run of blocks.
+ * When a record doesn't fit before the end of the buffer a wrap marker is left in the remaining
+ * blocks and the record starts again from the beginning, so the consumer always gets a plain pointer.
+ *
+ * Indices count blocks and are free running 8 bit counters like in SpscRing, so they are published
+ * atomically on AVR too and neither side has to mask interrupts.
+ */
+template <int GRANULES, int GRANULE_SIZE = 4>
+class ByteRing {
+    static_assert(GRANULES >= 2 && GRANULES <= 128 && (GRANULES & (GRANULES - 1)) == 0,
+                  "ByteRing granules must be a power of two, up to 128");
+    static_assert(GRANULE_SIZE >= 4 && (GRANULE_SIZE % 4) == 0, "ByteRing granule size must be a multiple of 4");
+
+    static const uint8_t MASK = GRANULES - 1;
+    static const uint16_t WRAP_MARKER = 0xffff;
+
+public:
+    // record length, padded so that the data is 32 bit aligned
+    static const uint8_t HEADER_SIZE = 4;
+    static const uint16_t CAPACITY = GRANULES * GRANULE_SIZE;
+    static const uint16_t MAX_RECORD_SIZE = CAPACITY - HEADER_SIZE;
+
+private:
+    alignas(4) uint8_t ring[CAPACITY];
+    volatile uint8_t head = 0;
+    volatile uint8_t tail = 0;
+    // producer only: blocks skipped by the pending reservation to wrap around
+    uint8_t mSkip = 0;
+    // blocks in use, highest seen by the producer
+    volatile uint8_t mHighWater = 0;
+
+    uint8_t *block(uint8_t index) {
+        return &ring[(index & MASK) * GRANULE_SIZE];
+    }
+
+    static uint16_t granules(uint16_t len) {
+        return (HEADER_SIZE + len + GRANULE_SIZE - 1) / GRANULE_SIZE;
+    }
+
+    static uint16_t recordLength(const uint8_t *record) {
+        return record[0] | (record[1] << 8);
+    }
+
+    static void setRecordLength(uint8_t *record, uint16_t len) {
+        record[0] = len & 0xff;
+        record[1] = len >> 8;
+    }
+
+    // Consumer side: index of the oldest record, skipping the wrap marker if any
+    uint8_t oldest() {
+        uint8_t t = tail;
+        if (recordLength(block(t)) == WRAP_MARKER) {
+            t += GRANULES - (t & MASK);
+        }
+        return t;
+    }
+
+public:
+    ByteRing() = default;
+
+    bool empty() const {
+        return head == tail;
+    }
+
+    // Number of bytes in use, wasted tails included
+    uint16_t used() const {
+        return static_cast<uint8_t>(head - tail) * GRANULE_SIZE;
+    }
+
+    uint16_t highWater() const {
+        return mHighWater * GRANULE_SIZE;
+    }
+
+    // Producer side: returns room for len contiguous bytes, or nullptr if the ring is full.
+    uint8_t *reserve(uint16_t len) {
+        uint16_t need = granules(len);
+        uint8_t h = head;
+        uint8_t free = GRANULES - static_cast<uint8_t>(h - tail);
+        uint8_t contiguous = GRANULES - (h & MASK);
+
+        uint8_t skip = need > contiguous ? contiguous : 0;
+        if (need + skip > free) {
+            return nullptr;
+        }
+
+        if (skip > 0) {
+            setRecordLength(block(h), WRAP_MARKER);
+        }
+        mSkip = skip;
+        SPSC_BARRIER();
+        return block(h + skip) + HEADER_SIZE;
+    }
+
+    // Publishes the reserved record; len can be shorter than the reserved length.
+    void commit(uint16_t len) {
+        uint8_t h = head + mSkip;
+        setRecordLength(block(h), len);
+        SPSC_BARRIER();
+        head = h + granules(len);
+
+        uint8_t inUse = head - tail;
+        if (inUse > mHighWater) {
+            mHighWater = inUse;
+        }
+    }
+
+    // Consumer side: returns the oldest record and its length, or nullptr if the ring is empty.
+    uint8_t *peek(uint16_t &len) {
+        if (empty()) {
+            return nullptr;
+        }
+        SPSC_BARRIER();
+        uint8_t *record = block(oldest());
+        len = recordLength(record);
+        return record + HEADER_SIZE;
+    }
+
+    void release() {
+        uint8_t t = oldest();
+        uint16_t len = recordLength(block(t));
+        SPSC_BARRIER();
+        tail = t + granules(len);
+    }
+};
+
+#endif //CCSNIFFER_BYTERING_H
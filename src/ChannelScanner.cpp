@@ -0,0 +1,178 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+#include <Arduino.h>
+#include "ChannelScanner.h"
+#include "cc1101consts.h"
+#include "RadioProfile.h"
+
+// FREQ2:FREQ1:FREQ0 = f * 2^16 / f_xosc, in integer maths: kHz * 4096 / 1625 fits 32 bits up to 1 GHz
+static_assert(CC1101_CRYSTAL_FREQ == 26.0, "kHz to FREQ conversion assumes a 26 MHz crystal");
+
+namespace {
+bool parseNumber(const char *&p, uint32_t &value)
+{
+    if (*p < '0' || *p > '9') {
+        return false;
+    }
+    value = 0;
+    while (*p >= '0' && *p <= '9') {
+        value = value * 10 + (*p - '0');
+        ++p;
+    }
+    return true;
+}
+}
+
+ChannelScanner::ChannelScanner(CC1101Tranceiver &radio)
+        : mRadio(radio)
+{
+}
+
+bool ChannelScanner::configure(const char *args)
+{
+    if (mActive) {
+        stop();
+    }
+
+    HopChannel base;
+    mRadio.currentChannel(base);
+
+    uint8_t n = 0;
+    const char *p = args;
+    while (*p != '\0') {
+        if (n == SCAN_MAX_CHANNELS) {
+            return false;
+        }
+
+        Channel &channel = mChannels[n];
+        channel.hop = base;
+        uint32_t value;
+        char kind = *p++;
+        if (!parseNumber(p, value)) {
+            return false;
+        }
+        if (kind == 'c' && value <= 0xff) {
+            channel.hop.channr = value;
+        } else if (kind == 'f' && RadioProfile::isValidFrequency(value / 1000.0f)) {
+            channel.hop.frf = value * 4096 / 1625;
+            channel.hop.channr = 0;
+        } else {
+            return false;
+        }
+
+        channel.dwellMs = DEFAULT_DWELL_MS;
+        if (*p == ':') {
+            ++p;
+            if (!parseNumber(p, value) || value == 0 || value > 0xffff) {
+                return false;
+            }
+            channel.dwellMs = value;
+        }
+        channel.hops = 0;
+        channel.hopUs = 0;
+        channel.packets = 0;
+        ++n;
+
+        if (*p == ',') {
+            ++p;
+        } else if (*p != '\0') {
+            return false;
+        }
+    }
+
+    mNumChannels = n;
+    return n > 0;
+}
+
+void ChannelScanner::start()
+{
+    if (mNumChannels == 0) {
+        return;
+    }
+
+    mRadio.currentChannel(mHome);
+
+    // calibrations take about 1 ms each, keep the receive interrupts off the bus meanwhile
+    noInterrupts();
+    mRadio.setFastHopping(true);
+    interrupts();
+    for (uint8_t i = 0; i < mNumChannels; ++i) {
+        noInterrupts();
+        mRadio.calibrateChannel(mChannels[i].hop);
+        interrupts();
+    }
+
+    noInterrupts();
+    mCurrent = 0;
+    mRadio.hopTo(mChannels[0].hop);
+    mActive = true;
+    interrupts();
+    mDwellStart = millis();
+}
+
+void ChannelScanner::stop()
+{
+    if (!mActive) {
+        return;
+    }
+
+    noInterrupts();
+    mActive = false;
+    mRadio.calibrateChannel(mHome);
+    mRadio.setFastHopping(false);
+    mRadio.receive();
+    interrupts();
+}
+
+void ChannelScanner::poll()
+{
+    if (!mActive || mNumChannels < 2 || millis() - mDwellStart < mChannels[mCurrent].dwellMs) {
+        return;
+    }
+
+    noInterrupts();
+    if (mRadio.packetPending()) {
+        // try again on the next loop, the packet will be counted on this channel
+        interrupts();
+        return;
+    }
+
+    uint8_t next = mCurrent + 1 < mNumChannels ? mCurrent + 1 : 0;
+    unsigned long start = micros();
+    mRadio.hopTo(mChannels[next].hop);
+    uint32_t elapsed = micros() - start;
+    mCurrent = next;
+    interrupts();
+
+    Channel &channel = mChannels[next];
+    ++channel.hops;
+    channel.hopUs += elapsed;
+    mDwellStart = millis();
+}
+
+void ChannelScanner::printStats()
+{
+    for (uint8_t i = 0; i < mNumChannels; ++i) {
+        Channel &channel = mChannels[i];
+        noInterrupts();
+        uint16_t packets = channel.packets;
+        interrupts();
+
+        Serial.print(F("+SCAN ch="));
+        Serial.print(i);
+        Serial.print(F(",freq="));
+        Serial.print(channel.hop.frf, HEX);
+        Serial.print(F(",chan="));
+        Serial.print(channel.hop.channr);
+        Serial.print(F(",dwell="));
+        Serial.print(channel.dwellMs);
+        Serial.print(F(",hops="));
+        Serial.print(channel.hops);
+        Serial.print(F(",hop_us="));
+        Serial.print(channel.hops != 0 ? channel.hopUs / channel.hops : 0);
+        Serial.print(F(",pkts="));
+        Serial.println(packets);
+    }
+}
@@ -0,0 +1,66 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+#ifndef CCSNIFFER_CHANNELSCANNER_H
+#define CCSNIFFER_CHANNELSCANNER_H
+
+#include <stdint.h>
+#include "cc1101.h"
+
+#ifndef SCAN_MAX_CHANNELS
+#if defined (BOARD_HUZZAH32)
+#define SCAN_MAX_CHANNELS 8
+#else
+#define SCAN_MAX_CHANNELS 4
+#endif
+#endif
+
+// Hops over a list of channels, staying on each for its dwell time.
+// Every channel is calibrated once when the scan starts; hops then restore the cached
+// calibration, so that the synthesizer only has to settle.
+class ChannelScanner {
+public:
+    static const uint16_t DEFAULT_DWELL_MS = 100;
+
+    explicit ChannelScanner(CC1101Tranceiver &radio);
+
+    // Comma separated channels, c<CHANNR> on the current base frequency or f<kHz> within the bands
+    // of the chip, each optionally followed by :<dwell ms>. E.g. "c0:50,c4:50,f869525:200"
+    bool configure(const char *args);
+    void start();
+    void stop();
+    bool active() const { return mActive; }
+
+    // From loop(): hops once the dwell time is over, but never in the middle of a packet
+    void poll();
+
+    // From the receive interrupt, counts the packet on the current channel
+    void packetReceived()
+    {
+        if (mActive) {
+            ++mChannels[mCurrent].packets;
+        }
+    }
+
+    void printStats();
+
+private:
+    struct Channel {
+        HopChannel hop;
+        uint16_t dwellMs;
+        uint16_t hops;
+        uint32_t hopUs;             // total, for the average hop time
+        volatile uint16_t packets;
+    };
+
+    CC1101Tranceiver &mRadio;
+    Channel mChannels[SCAN_MAX_CHANNELS];
+    uint8_t mNumChannels = 0;
+    volatile uint8_t mCurrent = 0;
+    bool mActive = false;
+    unsigned long mDwellStart = 0;
+    HopChannel mHome;
+};
+
+#endif //CCSNIFFER_CHANNELSCANNER_H
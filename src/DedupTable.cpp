@@ -0,0 +1,74 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+#include <string.h>
+#include "DedupTable.h"
+#include "Frame.h"
+
+#if DEDUP_ENTRIES > 0
+bool DedupTable::setWindow(uint16_t ms)
+{
+    mWindowUs = static_cast<uint32_t>(ms) * 1000;
+    for (auto &entry : mEntries) {
+        entry.packet = nullptr;
+    }
+    return true;
+}
+
+uint16_t DedupTable::hash(const uint8_t *payload, uint8_t len)
+{
+    return frameCrc(0xffff, payload, len);
+}
+
+bool DedupTable::fold(uint16_t hash, const uint8_t *payload, uint8_t len, PacketStatus status, uint8_t rssi,
+                      uint32_t timestamp)
+{
+    if (mWindowUs == 0) {
+        return false;
+    }
+
+    for (auto &entry : mEntries) {
+        Packet *packet = entry.packet;
+        if (packet == nullptr || entry.hash != hash || packet->len() != len || packet->getStatus() != status ||
+            timestamp - packet->getTimestamp().low >= mWindowUs || memcmp(packet->data(), payload, len) != 0) {
+            continue;
+        }
+        packet->addCopy(rssi);
+        ++mFolded;
+        return true;
+    }
+    return false;
+}
+
+void DedupTable::add(uint16_t hash, Packet *packet)
+{
+    if (mWindowUs == 0) {
+        return;
+    }
+
+    // a free entry, or the one of the oldest packet
+    Entry *slot = &mEntries[0];
+    uint32_t now = packet->getTimestamp().low;
+    for (auto &entry : mEntries) {
+        if (entry.packet == nullptr) {
+            slot = &entry;
+            break;
+        }
+        if (now - entry.packet->getTimestamp().low > now - slot->packet->getTimestamp().low) {
+            slot = &entry;
+        }
+    }
+    slot->hash = hash;
+    slot->packet = packet;
+}
+
+void DedupTable::forget(const Packet *packet)
+{
+    for (auto &entry : mEntries) {
+        if (entry.packet == packet) {
+            entry.packet = nullptr;
+        }
+    }
+}
+#endif
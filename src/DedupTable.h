@@ -0,0 +1,78 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+#ifndef CCSNIFFER_DEDUPTABLE_H
+#define CCSNIFFER_DEDUPTABLE_H
+
+#include <stdint.h>
+#include "PacketQueue.h"
+
+// 0 leaves the stage out of the build
+#ifndef DEDUP_ENTRIES
+#if defined (BOARD_HUZZAH32)
+#define DEDUP_ENTRIES 32
+#else
+#define DEDUP_ENTRIES 8
+#endif
+#endif
+
+// Duplicate suppression: a packet waits in the processed queue for the window after its sync word,
+// and the copies received meanwhile are folded into it (count and best RSSI) instead of being
+// queued. The table indexes the packets still waiting by payload hash, 4 bytes an entry on AVR;
+// when it is full the oldest packet is no longer matched.
+#if DEDUP_ENTRIES > 0
+class DedupTable {
+public:
+    // 0 disables it, returns false if the window can't be set
+    bool setWindow(uint16_t ms);
+    uint16_t window() const { return mWindowUs / 1000; }
+
+    static uint16_t hash(const uint8_t *payload, uint8_t len);
+
+    // Folds the packet into a waiting copy with the same payload and status, returns false if
+    // there is none
+    bool fold(uint16_t hash, const uint8_t *payload, uint8_t len, PacketStatus status, uint8_t rssi,
+              uint32_t timestamp);
+    void add(uint16_t hash, Packet *packet);
+
+    // true while a queued packet has to wait for its copies
+    bool held(const Packet *packet, uint32_t now) const
+    {
+        return now - packet->getTimestamp().low < mWindowUs;
+    }
+    // the packet is being written out, no more copies can be folded into it
+    void forget(const Packet *packet);
+
+    uint16_t folded() const { return mFolded; }
+
+private:
+    struct Entry {
+        uint16_t hash;
+        Packet *packet;
+    };
+
+    Entry mEntries[DEDUP_ENTRIES] = {};
+    uint32_t mWindowUs = 0;
+    uint16_t mFolded = 0;
+};
+#else
+// Left out of the build: no RAM, nothing is ever held or folded
+class DedupTable {
+public:
+    bool setWindow(uint16_t ms) { return ms == 0; }
+    uint16_t window() const { return 0; }
+
+    static uint16_t hash(const uint8_t *, uint8_t) { return 0; }
+
+    bool fold(uint16_t, const uint8_t *, uint8_t, PacketStatus, uint8_t, uint32_t) { return false; }
+    void add(uint16_t, Packet *) {}
+
+    bool held(const Packet *, uint32_t) const { return false; }
+    void forget(const Packet *) {}
+
+    uint16_t folded() const { return 0; }
+};
+#endif
+
+#endif //CCSNIFFER_DEDUPTABLE_H
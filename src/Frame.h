@@ -0,0 +1,204 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+#ifndef CCSNIFFER_FRAME_H
+#define CCSNIFFER_FRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Binary output protocol, shared by the firmware and the host decoder (no Arduino dependencies).
+//
+// A frame is type (1 byte), body, CRC-16/CCITT-FALSE of type and body (2 bytes), COBS encoded and
+// terminated by a 0x00 delimiter. Multi-byte fields are little endian.
+//
+//   Packet: sequence (2), timestamp in us (6), RSSI (1), LQI (1), status (1: bad CRC, 2: bad line code),
+//           copies (1), best RSSI (1), payload
+//   Fields: as Packet, with the protocol id (1) and the fields of the payload in place of the payload,
+//           each as its width (1) and its value most significant byte first, see ProtocolLayout.h
+//   Status: code (1), counter (2)
+//   Sweep:  start frequency in Hz (4), step in 10 Hz (2), number of steps N (1), RSSI (N)
+//
+// Text replies to commands may sit between frames; a 0x00 delimiter before the next frame keeps
+// them apart, a decoder reports any chunk that does not decode as text.
+enum class FrameType : uint8_t {
+    Packet = 0x01,
+    Status = 0x02,
+    Sweep = 0x03,
+    Fields = 0x04
+};
+
+enum class FrameStatus : uint8_t {
+    Timeout = 0x01,
+    Overflow = 0x02,
+    QueueFull = 0x03,
+    Sent = 0x04,
+    TxUnderflow = 0x05
+};
+
+const uint8_t FramePacketHeaderSize = 1 + 2 + 6 + 3 + 2;
+const uint8_t FrameCrcSize = 2;
+const uint8_t FrameMaxSegments = 4;
+
+struct FrameSegment {
+    const uint8_t *data;
+    uint16_t len;
+};
+
+// CRC-16/CCITT-FALSE (poly 0x1021, init 0xffff), byte at a time without a table
+inline uint16_t frameCrc(uint16_t crc, const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; ++i) {
+        crc = (crc >> 8) | (crc << 8);
+        crc ^= data[i];
+        crc ^= (crc & 0xff) >> 4;
+        crc ^= crc << 12;
+        crc ^= (crc & 0xff) << 5;
+    }
+    return crc;
+}
+
+// Encodes one frame a piece at a time: CRC appended, COBS encoded, 0x00 delimiter. The data of the
+// segments must stay in place until done(); the encoder itself must not be copied meanwhile.
+// Nothing is initialized before begin(), so that the encoder can share storage in a union.
+class FrameEncoder {
+public:
+    void begin(const FrameSegment *segments, uint8_t count)
+    {
+        uint16_t crc = 0xffff;
+        mTotal = 0;
+        for (uint8_t s = 0; s < count; ++s) {
+            crc = frameCrc(crc, segments[s].data, segments[s].len);
+            mSegments[s] = segments[s];
+            mTotal += segments[s].len;
+        }
+        mCrc[0] = static_cast<uint8_t>(crc);
+        mCrc[1] = static_cast<uint8_t>(crc >> 8);
+        mSegments[count] = FrameSegment{mCrc, FrameCrcSize};
+        mTotal += FrameCrcSize;
+
+        mPos = 0;
+        mState = State::Code;
+    }
+
+    // Encodes up to max bytes into out, returns how many
+    uint16_t read(uint8_t *out, uint16_t max)
+    {
+        uint16_t n = 0;
+        while (n < max && mState != State::Done) {
+            switch (mState) {
+                case State::Code:
+                    // a block is a code byte and up to 254 non zero bytes, the code stands for the next zero
+                    mRun = 0;
+                    while (mPos + mRun < mTotal && mRun < 254 && at(mPos + mRun) != 0) {
+                        ++mRun;
+                    }
+                    out[n++] = mRun + 1;
+                    mRemaining = mRun;
+                    mState = State::Data;
+                    break;
+                case State::Data:
+                    if (mRemaining > 0) {
+                        out[n++] = at(mPos++);
+                        --mRemaining;
+                    } else if (mPos == mTotal) {
+                        mState = State::Delimiter;
+                    } else {
+                        if (mRun < 254) {
+                            // skip the zero
+                            ++mPos;
+                        }
+                        mState = State::Code;
+                    }
+                    break;
+                case State::Delimiter:
+                    out[n++] = 0;
+                    mState = State::Done;
+                    break;
+                case State::Done:
+                    break;
+            }
+        }
+        return n;
+    }
+
+    bool done() const { return mState == State::Done; }
+
+private:
+    enum class State : uint8_t {
+        Code, Data, Delimiter, Done
+    };
+
+    // byte i of the concatenated segments
+    uint8_t at(uint16_t i) const
+    {
+        uint8_t s = 0;
+        while (i >= mSegments[s].len) {
+            i -= mSegments[s].len;
+            ++s;
+        }
+        return mSegments[s].data[i];
+    }
+
+    FrameSegment mSegments[FrameMaxSegments + 1];
+    uint8_t mCrc[FrameCrcSize];
+    uint16_t mTotal;
+    uint16_t mPos;
+    uint8_t mRun;
+    uint8_t mRemaining;
+    State mState;
+};
+
+// Writes the segments as one frame to sink(uint8_t)
+template<typename Sink>
+void writeFrame(const FrameSegment *segments, uint8_t count, Sink sink)
+{
+    FrameEncoder encoder;
+    encoder.begin(segments, count);
+    uint8_t chunk[16];
+    while (!encoder.done()) {
+        uint16_t n = encoder.read(chunk, sizeof(chunk));
+        for (uint16_t i = 0; i < n; ++i) {
+            sink(chunk[i]);
+        }
+    }
+}
+
+// Decodes a COBS frame without its delimiter and checks the CRC. Returns the length of type and
+// body, or -1 if the data is not a valid frame.
+inline int readFrame(const uint8_t *in, size_t len, uint8_t *out, size_t maxlen)
+{
+    size_t n = 0;
+    size_t i = 0;
+    while (i < len) {
+        uint8_t code = in[i++];
+        if (code == 0) {
+            return -1;
+        }
+        for (uint8_t k = 1; k < code; ++k) {
+            if (i == len || in[i] == 0 || n == maxlen) {
+                return -1;
+            }
+            out[n++] = in[i++];
+        }
+        if (code != 0xff && i < len) {
+            if (n == maxlen) {
+                return -1;
+            }
+            out[n++] = 0;
+        }
+    }
+
+    if (n < 1 + FrameCrcSize) {
+        return -1;
+    }
+    n -= FrameCrcSize;
+    uint16_t crc = frameCrc(0xffff, out, n);
+    if (out[n] != static_cast<uint8_t>(crc) || out[n + 1] != static_cast<uint8_t>(crc >> 8)) {
+        return -1;
+    }
+    return n;
+}
+
+#endif //CCSNIFFER_FRAME_H
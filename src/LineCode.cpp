@@ -0,0 +1,130 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+#include <Arduino.h>
+#include "LineCode.h"
+
+// Lookup tables in program memory, computed at compile time: code word to nibble, 0xff if invalid.
+namespace {
+template<uint16_t... I>
+struct TableIndices {};
+
+template<uint16_t N, uint16_t... I>
+struct MakeTableIndices : MakeTableIndices<N - 1, N - 1, I...> {};
+
+template<uint16_t... I>
+struct MakeTableIndices<0, I...> : TableIndices<I...> {};
+
+template<uint16_t N>
+struct LookupTable {
+    uint8_t entries[N];
+};
+
+// Manchester: a byte holds four chip pairs, i.e. one nibble
+constexpr bool isManchesterPair(uint8_t pair)
+{
+    return pair == 0b01 || pair == 0b10;
+}
+
+constexpr uint8_t manchesterEntry(uint8_t chips)
+{
+    return isManchesterPair(chips >> 6) && isManchesterPair((chips >> 4) & 3) &&
+           isManchesterPair((chips >> 2) & 3) && isManchesterPair(chips & 3)
+           ? ((chips >> 4) & 0x08) | ((chips >> 3) & 0x04) | ((chips >> 2) & 0x02) | ((chips >> 1) & 0x01)
+           : 0xff;
+}
+
+// 3-of-6: code words of the nibbles 0 - F
+constexpr uint8_t threeOfSixCodes[16] = {
+        0x16, 0x0d, 0x0e, 0x0b, 0x1c, 0x19, 0x1a, 0x13, 0x2c, 0x25, 0x26, 0x23, 0x34, 0x31, 0x32, 0x29
+};
+
+constexpr uint8_t threeOfSixEntry(uint8_t code, uint8_t nibble = 0)
+{
+    return nibble == 16 ? 0xff : threeOfSixCodes[nibble] == code ? nibble : threeOfSixEntry(code, nibble + 1);
+}
+
+template<uint16_t... I>
+constexpr LookupTable<sizeof...(I)> manchesterTable(TableIndices<I...>)
+{
+    return LookupTable<sizeof...(I)>{{manchesterEntry(I)...}};
+}
+
+template<uint16_t... I>
+constexpr LookupTable<sizeof...(I)> threeOfSixTable(TableIndices<I...>)
+{
+    return LookupTable<sizeof...(I)>{{threeOfSixEntry(I)...}};
+}
+
+const LookupTable<256> manchester PROGMEM = manchesterTable(MakeTableIndices<256>());
+const LookupTable<64> threeOfSix PROGMEM = threeOfSixTable(MakeTableIndices<64>());
+
+static_assert(manchesterEntry(0b10101010) == 0x0f && manchesterEntry(0b01010110) == 0x01 &&
+              manchesterEntry(0b11010101) == 0xff, "Manchester table");
+static_assert(threeOfSixEntry(0x16) == 0x00 && threeOfSixEntry(0x29) == 0x0f && threeOfSixEntry(0x00) == 0xff,
+              "3-of-6 table");
+
+uint8_t decodeManchester(const uint8_t *in, uint8_t len, uint8_t *out, bool &valid)
+{
+    uint8_t n = len / 2;
+    for (uint8_t i = 0; i < n; ++i) {
+        uint8_t high = pgm_read_byte(&manchester.entries[*in++]);
+        uint8_t low = pgm_read_byte(&manchester.entries[*in++]);
+        if ((high | low) & 0xf0) {
+            valid = false;
+            return i;
+        }
+        *out++ = (high << 4) | low;
+    }
+    return n;
+}
+
+uint8_t decodeThreeOfSix(const uint8_t *in, uint8_t len, uint8_t *out, bool &valid)
+{
+    // three bytes hold four code words, i.e. two bytes; two trailing bytes still hold one
+    uint8_t n = 0;
+    while (len >= 2) {
+        uint8_t a = in[0];
+        uint8_t b = in[1];
+        uint8_t n0 = pgm_read_byte(&threeOfSix.entries[a >> 2]);
+        uint8_t n1 = pgm_read_byte(&threeOfSix.entries[((a & 0x03) << 4) | (b >> 4)]);
+        if ((n0 | n1) & 0xf0) {
+            valid = false;
+            return n;
+        }
+        out[n++] = (n0 << 4) | n1;
+        if (len == 2) {
+            break;
+        }
+
+        uint8_t c = in[2];
+        uint8_t n2 = pgm_read_byte(&threeOfSix.entries[((b & 0x0f) << 2) | (c >> 6)]);
+        uint8_t n3 = pgm_read_byte(&threeOfSix.entries[c & 0x3f]);
+        if ((n2 | n3) & 0xf0) {
+            valid = false;
+            return n;
+        }
+        out[n++] = (n2 << 4) | n3;
+        in += 3;
+        len -= 3;
+    }
+    return n;
+}
+}
+
+uint8_t decodeLineCode(LineCode code, const uint8_t *in, uint8_t len, uint8_t *out, bool &valid)
+{
+    valid = true;
+    switch (code) {
+        case LineCode::Manchester:
+            return decodeManchester(in, len, out, valid);
+        case LineCode::ThreeOfSix:
+            return decodeThreeOfSix(in, len, out, valid);
+        default:
+            if (out != in) {
+                memcpy(out, in, len);
+            }
+            return len;
+    }
+}
@@ -0,0 +1,24 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+#ifndef CCSNIFFER_LINECODE_H
+#define CCSNIFFER_LINECODE_H
+
+#include <stdint.h>
+
+// Coding of the payload on top of what the chip delivers, set per radio profile
+enum class LineCode : uint8_t {
+    None = 0,
+    // two chips per bit, 10 for 1 and 01 for 0, first chip in the most significant bit
+    Manchester,
+    // Wireless M-Bus T mode (EN 13757-4): every nibble as a 6 bits code word, high nibble first
+    ThreeOfSix
+};
+
+// Decodes len bytes from in to out, out may be in (the decoded data is never longer). Returns the
+// decoded length; decoding stops at the first invalid code word, clearing valid. A trailing
+// partial code word is dropped.
+uint8_t decodeLineCode(LineCode code, const uint8_t *in, uint8_t len, uint8_t *out, bool &valid);
+
+#endif //CCSNIFFER_LINECODE_H
@@ -0,0 +1,226 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+#include <Arduino.h>
+#include <string.h>
+#include "PacketFilter.h"
+
+namespace {
+bool parseNumber(const char *&p, int16_t &value)
+{
+    bool negative = *p == '-';
+    if (negative) {
+        ++p;
+    }
+    if (*p < '0' || *p > '9') {
+        return false;
+    }
+    int16_t v = 0;
+    while (*p >= '0' && *p <= '9') {
+        v = v * 10 + (*p++ - '0');
+        if (v > 999) {
+            return false;
+        }
+    }
+    value = negative ? -v : v;
+    return true;
+}
+
+int8_t hexValue(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+// Hex bytes up to a delimiter, returns how many
+uint8_t parseHex(const char *&p, uint8_t *out, uint8_t max)
+{
+    uint8_t n = 0;
+    while (n < max && hexValue(p[0]) >= 0 && hexValue(p[1]) >= 0) {
+        out[n++] = (hexValue(p[0]) << 4) | hexValue(p[1]);
+        p += 2;
+    }
+    return n;
+}
+
+// word is in program memory
+bool startsWith(const char *&p, const char *word)
+{
+    size_t l = strlen_P(word);
+    if (strncmp_P(p, word, l) != 0) {
+        return false;
+    }
+    p += l;
+    return true;
+}
+
+void printHex(const uint8_t *data, uint8_t len)
+{
+    for (uint8_t i = 0; i < len; ++i) {
+        if (data[i] < 0x10) {
+            Serial.print('0');
+        }
+        Serial.print(data[i], HEX);
+    }
+}
+}
+
+bool PacketFilter::addRule(const char *args)
+{
+    if (mNumRules == FILTER_MAX_RULES) {
+        return false;
+    }
+
+    Rule rule;
+    const char *p = args;
+    while (*p != '\0') {
+        int16_t v1, v2;
+        if (startsWith(p, PSTR("len="))) {
+            if (!parseNumber(p, v1) || *p++ != '-' || !parseNumber(p, v2) || v1 < 0 || v2 > 255 || v1 > v2) {
+                return false;
+            }
+            rule.minLen = v1;
+            rule.maxLen = v2;
+        } else if (startsWith(p, PSTR("prefix="))) {
+            rule.prefixLen = parseHex(p, rule.value, FILTER_MAX_PREFIX);
+            if (rule.prefixLen == 0) {
+                return false;
+            }
+            memset(rule.mask, 0xff, sizeof(rule.mask));
+            if (*p == '/') {
+                ++p;
+                if (parseHex(p, rule.mask, rule.prefixLen) != rule.prefixLen) {
+                    return false;
+                }
+            }
+            for (uint8_t i = 0; i < rule.prefixLen; ++i) {
+                rule.value[i] &= rule.mask[i];
+            }
+        } else if (startsWith(p, PSTR("rssi="))) {
+            if (!parseNumber(p, v1)) {
+                return false;
+            }
+            rule.minRssi = v1;
+        } else if (startsWith(p, PSTR("crc"))) {
+            rule.crcOk = true;
+        } else {
+            return false;
+        }
+
+        if (*p == ' ') {
+            ++p;
+        } else if (*p != '\0') {
+            return false;
+        }
+    }
+
+    mRules[mNumRules++] = rule;
+    return true;
+}
+
+void PacketFilter::clear()
+{
+    mNumRules = 0;
+    mRejected = 0;
+}
+
+bool PacketFilter::matches(const Rule &rule, const uint8_t *payload, uint8_t len, uint8_t rssi, bool crcOk) const
+{
+    if (len < rule.minLen || len > rule.maxLen || len < rule.prefixLen || (rule.crcOk && !crcOk)) {
+        return false;
+    }
+    // RSSI is in 0.5 dB steps with a 74 dB offset: dBm * 2 = rssi - 148
+    if (static_cast<int8_t>(rssi) - 148 < 2 * rule.minRssi) {
+        return false;
+    }
+    for (uint8_t i = 0; i < rule.prefixLen; ++i) {
+        if ((payload[i] & rule.mask[i]) != rule.value[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool PacketFilter::accept(const uint8_t *payload, uint8_t len, uint8_t rssi, bool crcOk)
+{
+    if (mNumRules == 0 || match(payload, len, rssi, crcOk) >= 0) {
+        return true;
+    }
+    ++mRejected;
+    return false;
+}
+
+int8_t PacketFilter::match(const uint8_t *payload, uint8_t len, uint8_t rssi, bool crcOk)
+{
+    for (uint8_t r = 0; r < mNumRules; ++r) {
+        if (matches(mRules[r], payload, len, rssi, crcOk)) {
+            ++mRules[r].hits;
+            return r;
+        }
+    }
+    return -1;
+}
+
+bool PacketFilter::address(uint8_t &address) const
+{
+    if (mNumRules == 0) {
+        return false;
+    }
+    for (uint8_t r = 0; r < mNumRules; ++r) {
+        const Rule &rule = mRules[r];
+        if (rule.prefixLen == 0 || rule.mask[0] != 0xff || rule.value[0] != mRules[0].value[0]) {
+            return false;
+        }
+    }
+    address = mRules[0].value[0];
+    return true;
+}
+
+void PacketFilter::printRule(uint8_t r) const
+{
+    const Rule &rule = mRules[r];
+    Serial.print(F(",len="));
+    Serial.print(rule.minLen);
+    Serial.print(F("-"));
+    Serial.print(rule.maxLen);
+    if (rule.prefixLen != 0) {
+        Serial.print(F(",prefix="));
+        printHex(rule.value, rule.prefixLen);
+        Serial.print(F("/"));
+        printHex(rule.mask, rule.prefixLen);
+    }
+    Serial.print(F(",rssi="));
+    Serial.print(rule.minRssi);
+    Serial.print(F(",crc="));
+    Serial.print(rule.crcOk);
+    Serial.print(F(",hits="));
+    Serial.print(rule.hits);
+}
+
+void PacketFilter::printRules()
+{
+    for (uint8_t r = 0; r < mNumRules; ++r) {
+        Serial.print(F("+FILTER r="));
+        Serial.print(r);
+        printRule(r);
+        Serial.println();
+    }
+
+    uint8_t chipAddress;
+    Serial.print(F("+FILTER rejected="));
+    Serial.print(mRejected);
+    if (address(chipAddress)) {
+        Serial.print(F(",addr="));
+        printHex(&chipAddress, 1);
+    }
+    Serial.println();
+}
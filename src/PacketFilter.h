@@ -0,0 +1,60 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+#ifndef CCSNIFFER_PACKETFILTER_H
+#define CCSNIFFER_PACKETFILTER_H
+
+#include <stdint.h>
+
+// for +FILTER and, separately, for +CLASS; a rule takes 24 bytes on AVR
+#ifndef FILTER_MAX_RULES
+#if defined (BOARD_HUZZAH32)
+#define FILTER_MAX_RULES 4
+#else
+#define FILTER_MAX_RULES 2
+#endif
+#endif
+#define FILTER_MAX_PREFIX 8
+
+// Packets pass if they match any rule, or if there are no rules. Within a rule every condition
+// must hold: payload length range, masked match of the first bytes, minimum RSSI, CRC ok.
+class PacketFilter {
+public:
+    // Space separated conditions, e.g. "len=5-20 prefix=2dc5/ffff rssi=-90 crc"
+    bool addRule(const char *args);
+    void clear();
+    uint8_t numRules() const { return mNumRules; }
+
+    bool accept(const uint8_t *payload, uint8_t len, uint8_t rssi, bool crcOk);
+    // index of the first matching rule, -1 if none
+    int8_t match(const uint8_t *payload, uint8_t len, uint8_t rssi, bool crcOk);
+
+    // True if every rule requires the same first byte, which the chip can then check by itself
+    // (PKTCTRL1 ADR_CHK and ADDR) and drop the other packets before they are read over SPI.
+    bool address(uint8_t &address) const;
+
+    void printRules();
+    // the conditions and hits of rule r, on the current line
+    void printRule(uint8_t r) const;
+
+private:
+    struct Rule {
+        uint8_t minLen = 0;
+        uint8_t maxLen = 255;
+        uint8_t prefixLen = 0;
+        uint8_t value[FILTER_MAX_PREFIX];
+        uint8_t mask[FILTER_MAX_PREFIX];
+        int16_t minRssi = -200;     // dBm
+        bool crcOk = false;
+        uint16_t hits = 0;
+    };
+
+    bool matches(const Rule &rule, const uint8_t *payload, uint8_t len, uint8_t rssi, bool crcOk) const;
+
+    Rule mRules[FILTER_MAX_RULES];
+    uint8_t mNumRules = 0;
+    uint16_t mRejected = 0;
+};
+
+#endif //CCSNIFFER_PACKETFILTER_H
@@ -0,0 +1,173 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+#include <Arduino.h>
+#include <string.h>
+#include "PacketOutput.h"
+
+namespace {
+const char hexDigits[] PROGMEM = "0123456789ABCDEF";
+const char badCrc[] PROGMEM = ",BADCRC";
+const char badCode[] PROGMEM = ",BADCODE";
+
+uint8_t formatDecimal(uint16_t value, char *out)
+{
+    char reversed[5];
+    uint8_t n = 0;
+    do {
+        reversed[n++] = '0' + value % 10;
+        value /= 10;
+    } while (value != 0);
+
+    for (uint8_t i = 0; i < n; ++i) {
+        out[i] = reversed[n - 1 - i];
+    }
+    return n;
+}
+}
+
+void PacketOutput::begin(const Packet *packet, bool binary, bool delimiter)
+{
+    mPacket = packet;
+    mPos = 0;
+
+    if (binary) {
+        Timestamp timestamp = packet->getTimestamp();
+        uint16_t sequence = packet->getSequence();
+        uint8_t protocol = packet->getProtocol();
+        uint8_t header[FramePacketHeaderSize + 1] = {
+                static_cast<uint8_t>(protocol != 0 ? FrameType::Fields : FrameType::Packet),
+                static_cast<uint8_t>(sequence), static_cast<uint8_t>(sequence >> 8),
+                static_cast<uint8_t>(timestamp.low), static_cast<uint8_t>(timestamp.low >> 8),
+                static_cast<uint8_t>(timestamp.low >> 16), static_cast<uint8_t>(timestamp.low >> 24),
+                static_cast<uint8_t>(timestamp.high), static_cast<uint8_t>(timestamp.high >> 8),
+                packet->getRssi(), packet->getLqi(), static_cast<uint8_t>(packet->getStatus()),
+                packet->getCopies(), packet->getBestRssi(), protocol
+        };
+        memcpy(mBinary.header, header, sizeof(mBinary.header));
+        // the protocol id only goes with the fields
+        FrameSegment segments[] = {{mBinary.header,
+                                    static_cast<uint16_t>(protocol != 0 ? sizeof(mBinary.header) : sizeof(mBinary.header) - 1)},
+                                   {packet->data(), packet->len()}};
+        mBinary.frame.begin(segments, 2);
+        mStage = delimiter ? Stage::Delimiter : Stage::Frame;
+        return;
+    }
+
+    char *p = mText.prefix;
+    *p++ = '*';
+    p += formatDecimal(packet->getSequence(), p);
+    *p++ = ',';
+    p += formatTimestamp(packet->getTimestamp(), p);
+    *p++ = ',';
+    p += formatDecimal(packet->getRssi(), p);
+    *p++ = ',';
+    p += formatDecimal(packet->getLqi(), p);
+    *p++ = ',';
+    if (packet->getProtocol() != 0) {
+        *p++ = '@';
+        p += formatDecimal(packet->getProtocol(), p);
+        mFieldEnd = 0;
+        mLowNibble = false;
+    }
+    mPrefixLen = p - mText.prefix;
+
+    p = mText.suffix;
+    if (packet->getCopies() > 1) {
+        *p++ = ',';
+        *p++ = 'x';
+        p += formatDecimal(packet->getCopies(), p);
+        *p++ = ':';
+        p += formatDecimal(packet->getBestRssi(), p);
+    }
+    if (packet->getStatus() == CRCError) {
+        memcpy_P(p, badCrc, sizeof(badCrc) - 1);
+        p += sizeof(badCrc) - 1;
+    } else if (packet->getStatus() == CodingError) {
+        memcpy_P(p, badCode, sizeof(badCode) - 1);
+        p += sizeof(badCode) - 1;
+    }
+    *p++ = '\r';
+    *p++ = '\n';
+    *p = '\0';
+    mStage = Stage::Prefix;
+}
+
+uint16_t PacketOutput::read(uint8_t *out, uint16_t max)
+{
+    uint16_t n = 0;
+    while (n < max && mStage != Stage::Done) {
+        switch (mStage) {
+            case Stage::Delimiter:
+                out[n++] = 0;
+                mStage = Stage::Frame;
+                break;
+            case Stage::Frame:
+                n += mBinary.frame.read(&out[n], max - n);
+                if (mBinary.frame.done()) {
+                    mStage = Stage::Done;
+                }
+                break;
+            case Stage::Prefix:
+                while (n < max && mPos < mPrefixLen) {
+                    out[n++] = mText.prefix[mPos++];
+                }
+                if (mPos == mPrefixLen) {
+                    mPos = 0;
+                    mStage = mPacket->getProtocol() != 0 ? Stage::Fields : Stage::Payload;
+                }
+                break;
+            case Stage::Payload: {
+                // mPos counts hex digits, two per payload byte
+                const uint8_t *data = mPacket->data();
+                uint16_t digits = 2 * mPacket->len();
+                while (n < max && mPos < digits) {
+                    uint8_t byte = data[mPos >> 1];
+                    out[n++] = pgm_read_byte(&hexDigits[(mPos & 1) ? (byte & 0x0f) : (byte >> 4)]);
+                    ++mPos;
+                }
+                if (mPos == digits) {
+                    mPos = 0;
+                    mStage = Stage::Suffix;
+                }
+                break;
+            }
+            case Stage::Fields: {
+                // width byte, then the value in hex, for every field
+                const uint8_t *data = mPacket->data();
+                uint8_t len = mPacket->len();
+                while (n < max && mPos < len) {
+                    if (mPos == mFieldEnd) {
+                        out[n++] = ',';
+                        mFieldEnd = mPos + 1 + data[mPos];
+                        ++mPos;
+                        continue;
+                    }
+                    uint8_t byte = data[mPos];
+                    out[n++] = pgm_read_byte(&hexDigits[mLowNibble ? (byte & 0x0f) : (byte >> 4)]);
+                    if (mLowNibble) {
+                        ++mPos;
+                    }
+                    mLowNibble = !mLowNibble;
+                }
+                if (mPos == len) {
+                    mPos = 0;
+                    mStage = Stage::Suffix;
+                }
+                break;
+            }
+            case Stage::Suffix:
+                while (n < max && mText.suffix[mPos] != '\0') {
+                    out[n++] = mText.suffix[mPos++];
+                }
+                if (mText.suffix[mPos] == '\0') {
+                    mStage = Stage::Done;
+                }
+                break;
+            case Stage::Done:
+                break;
+        }
+    }
+    return n;
+}
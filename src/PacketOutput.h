@@ -0,0 +1,57 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+#ifndef CCSNIFFER_PACKETOUTPUT_H
+#define CCSNIFFER_PACKETOUTPUT_H
+
+#include <stdint.h>
+#include "Frame.h"
+#include "PacketQueue.h"
+
+// Formats a queued packet for the serial port a piece at a time, as the TX buffer has room, so that
+// the output never waits for the UART. The packet stays in the queue until done().
+//
+// Text: *sequence,timestamp,rssi,lqi,HEXPAYLOAD[,x<copies>:<best rssi>][,BADCRC|,BADCODE] and CR/LF
+//       or, for the fields of a known protocol, *sequence,timestamp,rssi,lqi,@protocol,HEXFIELD,...
+// Binary: a packet or fields frame, see Frame.h, optionally preceded by a 0x00 delimiter
+class PacketOutput {
+public:
+    void begin(const Packet *packet, bool binary, bool delimiter);
+
+    // Formats up to max bytes into out, returns how many
+    uint16_t read(uint8_t *out, uint16_t max);
+
+    bool done() const { return mStage == Stage::Done; }
+
+private:
+    enum class Stage : uint8_t {
+        Delimiter, Frame, Prefix, Payload, Fields, Suffix, Done
+    };
+
+    const Packet *mPacket = nullptr;
+    Stage mStage = Stage::Done;
+    uint16_t mPos = 0;
+
+    uint8_t mPrefixLen = 0;
+    // fields: end of the current one, second hex digit of the byte next
+    uint8_t mFieldEnd = 0;
+    bool mLowNibble = false;
+
+    // a packet is either text or a frame, the two never need their buffers at the same time
+    union {
+        struct {
+            // '*', 5 + 15 + 3 + 3 digits, 4 commas, '@' and 3 digits
+            char prefix[36];
+            // ",x255:255,BADCODE" and CR/LF
+            char suffix[20];
+        } mText;
+        struct {
+            // packet header and protocol id
+            uint8_t header[FramePacketHeaderSize + 1];
+            FrameEncoder frame;
+        } mBinary;
+    };
+};
+
+#endif //CCSNIFFER_PACKETOUTPUT_H
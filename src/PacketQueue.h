@@ -7,33 +7,56 @@
 
 #include <Arduino.h>
 #include <stdint.h>
+#include "ByteRing.h"
+#include "LineCode.h"
+#include "Timestamp.h"
 
 
 enum PacketStatus : uint8_t {
-    PacketOK = 0x00, CRCError=0x01
+    PacketOK = 0x00, CRCError=0x01, CodingError=0x02
 };
 
-#define DEFAULT_PACKET_SIZE 64
-#define DEFAULT_QUEUE_LENGTH 3
+#define DEFAULT_QUEUE_GRANULES 64
 
-template <int PKTSIZE = DEFAULT_PACKET_SIZE>
+// A packet as stored in a PacketsQueue: this header is immediately followed by the payload,
+// so packets only live inside the queue and are handled by pointer.
 class Packet {
 private:
-    uint8_t buffer[PKTSIZE];
     uint8_t length = 0;
     uint8_t lqi = 0;
     uint8_t rssi = 0;
     PacketStatus status = PacketStatus::PacketOK;
+    uint8_t copies = 1;
+    uint8_t bestRssi = 0;
+    uint8_t protocol = 0;
+    uint16_t sequence = 0;
+    uint16_t timestampHigh = 0;
+    uint32_t timestampLow = 0;
 
 public:
-    static const uint8_t RAWSIZE = PKTSIZE+4;
-
-    Packet() {
-
+    Packet() = default;
+    Packet(const Packet &) = delete;
+    Packet &operator=(const Packet &) = delete;
+
+    void clear() {
+        length = 0;
+        lqi = 0;
+        rssi = 0;
+        status = PacketStatus::PacketOK;
+        copies = 1;
+        bestRssi = 0;
+        protocol = 0;
+        sequence = 0;
+        timestampHigh = 0;
+        timestampLow = 0;
     }
 
     const uint8_t *data() const {
-        return &buffer[0];
+        return reinterpret_cast<const uint8_t *>(this + 1);
+    }
+
+    uint8_t *data() {
+        return reinterpret_cast<uint8_t *>(this + 1);
     }
 
     uint8_t len() const {
@@ -58,6 +81,7 @@ public:
     void setRssi(uint8_t rssi)
     {
         Packet::rssi = rssi;
+        bestRssi = rssi;
     }
 
     PacketStatus getStatus() const
@@ -70,111 +94,249 @@ public:
         Packet::status = status;
     }
 
-    void rawCopyFrom(uint8_t *memory, uint8_t len) {
-        length = len;
-        if (length > PKTSIZE) {
-            length = PKTSIZE;
+    // times the packet was received, the repeats are folded into the first copy
+    uint8_t getCopies() const
+    {
+        return copies;
+    }
+
+    // strongest RSSI among the copies
+    uint8_t getBestRssi() const
+    {
+        return bestRssi;
+    }
+
+    void addCopy(uint8_t rssi)
+    {
+        if (copies < 0xff) {
+            ++copies;
         }
-        memcpy(buffer, memory, length);
+        if (static_cast<int8_t>(rssi) > static_cast<int8_t>(bestRssi)) {
+            bestRssi = rssi;
+        }
+    }
+
+    // 0 if the data is the payload, else the id of the protocol whose fields it holds,
+    // see ProtocolLayout.h
+    uint8_t getProtocol() const
+    {
+        return protocol;
+    }
+
+    void setProtocol(uint8_t protocol)
+    {
+        Packet::protocol = protocol;
+    }
+
+    uint16_t getSequence() const
+    {
+        return sequence;
+    }
+
+    void setSequence(uint16_t sequence)
+    {
+        Packet::sequence = sequence;
+    }
+
+    // time of the sync word interrupt
+    Timestamp getTimestamp() const
+    {
+        Timestamp t;
+        t.low = timestampLow;
+        t.high = timestampHigh;
+        return t;
+    }
+
+    void setTimestamp(const Timestamp &timestamp)
+    {
+        timestampLow = timestamp.low;
+        timestampHigh = timestamp.high;
+    }
+
+    // memory must fit the length reserved in the queue
+    void rawCopyFrom(const uint8_t *memory, uint8_t len) {
+        length = len;
+        memcpy(data(), memory, length);
     }
 
     uint8_t rawCopyTo(uint8_t *memory, uint8_t maxlen) const {
         uint8_t len = length;
         if (len > maxlen)
             len = maxlen;
-        memcpy(memory, buffer, len);
+        memcpy(memory, data(), len);
         return len;
     }
 };
 
-template <int PKTQUEUELEN = DEFAULT_QUEUE_LENGTH, int PKTSIZE = DEFAULT_PACKET_SIZE>
-class RawPacketsQueue {
+// A raw packet as stored in a RawPacketsQueue: this header is immediately followed by the bytes
+// read from the FIFO (length byte, payload, RSSI and LQI/CRC status bytes).
+class RawPacket {
+private:
+    uint16_t length = 0;
+    uint16_t sequence = 0;
+    uint16_t timestampHigh = 0;
+    LineCode lineCode = LineCode::None;
+    uint32_t timestampLow = 0;
+
 public:
-    struct RawPacket {
-        uint8_t length = 0;
-        uint8_t buffer[PKTSIZE];
-    };
+    RawPacket() = default;
+    RawPacket(const RawPacket &) = delete;
+    RawPacket &operator=(const RawPacket &) = delete;
+
+    const uint8_t *data() const {
+        return reinterpret_cast<const uint8_t *>(this + 1);
+    }
+
+    uint8_t *data() {
+        return reinterpret_cast<uint8_t *>(this + 1);
+    }
+
+    uint16_t len() const {
+        return length;
+    }
+
+    void setLength(uint16_t length)
+    {
+        RawPacket::length = length;
+    }
+
+    uint16_t getSequence() const
+    {
+        return sequence;
+    }
+
+    void setSequence(uint16_t sequence)
+    {
+        RawPacket::sequence = sequence;
+    }
+
+    // line code of the profile the packet was received with
+    LineCode getLineCode() const
+    {
+        return lineCode;
+    }
 
+    void setLineCode(LineCode lineCode)
+    {
+        RawPacket::lineCode = lineCode;
+    }
+
+    Timestamp getTimestamp() const
+    {
+        Timestamp t;
+        t.low = timestampLow;
+        t.high = timestampHigh;
+        return t;
+    }
+
+    void setTimestamp(const Timestamp &timestamp)
+    {
+        timestampLow = timestamp.low;
+        timestampHigh = timestamp.high;
+    }
+};
+
+template <int GRANULES = DEFAULT_QUEUE_GRANULES, int GRANULE_SIZE = 4>
+class RawPacketsQueue {
 private:
-    RawPacket queue[PKTQUEUELEN];
-    uint8_t head = 0;
-    uint8_t tail = 0;
+    ByteRing<GRANULES, GRANULE_SIZE> queue;
+    RawPacket *mPending = nullptr;
 public:
-    static constexpr size_t MAX_PACKET_SIZE = PKTSIZE;
-
     RawPacketsQueue()= default;
 
     bool empty() const {
-        return head == tail;
+        return queue.empty();
     }
 
-    bool full() const {
-        return (head + 1) % PKTQUEUELEN == tail;
+    uint16_t highWater() const {
+        return queue.highWater();
     }
 
-    uint8_t push(const uint8_t *data, uint8_t len) {
-        if (full()) {
-            return 0;
-        }
-        uint8_t pos = head;
-        head = (head + 1) % PKTQUEUELEN;
-        queue[pos].length = len;
-        memcpy(queue[pos].buffer, data, len);
-        return len;
+    // Producer side, zero copy: fill the data of the packet returned by reserve() in place,
+    // then commit() it. reserve() returns nullptr if the queue is full.
+    RawPacket *reserve(uint16_t len) {
+        mPending = reinterpret_cast<RawPacket *>(queue.reserve(sizeof(RawPacket) + len));
+        return mPending;
     }
 
-    uint8_t pop(uint8_t *data, uint8_t maxlen) {
-        if (empty()) {
-            return 0;
-        }
-        uint8_t pos = tail;
-        tail = (tail + 1) % PKTQUEUELEN;
-        uint8_t len = queue[pos].length;
-        if (len > maxlen)
-            len = maxlen;
-        memcpy(data, queue[pos].buffer, len);
-        return len;
+    RawPacket *pending() {
+        return mPending;
+    }
+
+    void commit(uint16_t len) {
+        mPending->setLength(len);
+        queue.commit(sizeof(RawPacket) + len);
+        mPending = nullptr;
+    }
+
+    // Consumer side, zero copy: peek() returns the oldest packet (or nullptr), release() frees it.
+    // The packet belongs to the consumer until then, its data may be rewritten in place.
+    RawPacket *peek() {
+        uint16_t len;
+        return reinterpret_cast<RawPacket *>(queue.peek(len));
+    }
+
+    void release() {
+        queue.release();
     }
 };
 
-template <int PKTQUEUELEN = DEFAULT_QUEUE_LENGTH, int PKTSIZE = DEFAULT_PACKET_SIZE>
+template <int GRANULES = DEFAULT_QUEUE_GRANULES, int GRANULE_SIZE = 4>
 class PacketsQueue {
 public:
-    using PacketType = Packet<PKTSIZE>;
+    using PacketType = Packet;
 private:
-    PacketType queue[PKTQUEUELEN];
-    uint8_t head = 0;
-    uint8_t tail = 0;
+    ByteRing<GRANULES, GRANULE_SIZE> queue;
+    PacketType *mPending = nullptr;
 
 public:
     PacketsQueue() = default;
 
     bool empty() const {
-        return head == tail;
+        return queue.empty();
     }
 
-    bool full() const {
-        return (head + 1) % PKTQUEUELEN == tail;
+    uint16_t highWater() const {
+        return queue.highWater();
     }
 
-    uint8_t push(const PacketType &pkt) {
-        if (full()) {
-            return 0;
-        }
-        uint8_t pos = head;
-        head = (head + 1) % PKTQUEUELEN;
-        queue[pos] = pkt;
-        return 1;
+    // bytes in use and total, ring headers and padding included
+    uint16_t used() const {
+        return queue.used();
+    }
+
+    static uint16_t capacity() {
+        return ByteRing<GRANULES, GRANULE_SIZE>::CAPACITY;
     }
 
-    uint8_t pop(PacketType &pkt) {
-        if (empty()) {
-            return 0;
+    // bytes taken by a packet with len bytes of payload
+    static uint16_t footprint(uint8_t len) {
+        uint16_t size = ByteRing<GRANULES, GRANULE_SIZE>::HEADER_SIZE + sizeof(PacketType) + len;
+        return (size + GRANULE_SIZE - 1) / GRANULE_SIZE * GRANULE_SIZE;
+    }
+
+    // Reserves a packet with room for len bytes of payload, nullptr if the queue is full.
+    PacketType *reserve(uint8_t len) {
+        mPending = reinterpret_cast<PacketType *>(queue.reserve(sizeof(PacketType) + len));
+        if (mPending != nullptr) {
+            mPending->clear();
         }
-        uint8_t pos = tail;
-        tail = (tail + 1) % PKTQUEUELEN;
-        pkt = queue[pos];
-        return 1;
+        return mPending;
+    }
+
+    // Publishes the reserved packet, the payload may have been shortened in the meanwhile.
+    void commit() {
+        queue.commit(sizeof(PacketType) + mPending->len());
+        mPending = nullptr;
+    }
+
+    const PacketType *peek() {
+        uint16_t len;
+        return reinterpret_cast<const PacketType *>(queue.peek(len));
+    }
+
+    void release() {
+        queue.release();
     }
 };
 
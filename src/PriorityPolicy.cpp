@@ -0,0 +1,90 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+#include <Arduino.h>
+#include "PriorityPolicy.h"
+
+bool PriorityPolicy::addRule(uint8_t cls, const char *conditions)
+{
+    if (cls == 0 || cls >= PRIORITY_CLASSES) {
+        return false;
+    }
+    uint8_t r = mRules.numRules();
+    if (!mRules.addRule(conditions)) {
+        return false;
+    }
+    mRuleClass[r] = cls;
+    return true;
+}
+
+bool PriorityPolicy::setShare(uint8_t cls, uint8_t percent)
+{
+    if (cls == 0 || cls >= PRIORITY_CLASSES) {
+        return false;
+    }
+    uint16_t total = percent;
+    for (uint8_t c = 1; c < PRIORITY_CLASSES; ++c) {
+        if (c != cls) {
+            total += mShare[c];
+        }
+    }
+    if (total > 90) {
+        return false;
+    }
+    mShare[cls] = percent;
+    return true;
+}
+
+void PriorityPolicy::clear()
+{
+    mRules.clear();
+    for (uint8_t c = 0; c < PRIORITY_CLASSES; ++c) {
+        mShare[c] = 0;
+        mPackets[c] = 0;
+        mDrops[c] = 0;
+    }
+}
+
+uint8_t PriorityPolicy::classify(const uint8_t *payload, uint8_t len, uint8_t rssi, bool crcOk)
+{
+    int8_t r = mRules.match(payload, len, rssi, crcOk);
+    uint8_t cls = r >= 0 ? mRuleClass[r] : 0;
+    ++mPackets[cls];
+    return cls;
+}
+
+bool PriorityPolicy::admit(uint8_t cls, uint16_t size, uint16_t used, uint16_t capacity)
+{
+    uint8_t reserved = 0;
+    for (uint8_t c = cls + 1; c < PRIORITY_CLASSES; ++c) {
+        reserved += mShare[c];
+    }
+    if (reserved == 0 || used + size <= capacity - static_cast<uint32_t>(capacity) * reserved / 100) {
+        return true;
+    }
+    ++mDrops[cls];
+    return false;
+}
+
+void PriorityPolicy::printStats()
+{
+    for (uint8_t c = 0; c < PRIORITY_CLASSES; ++c) {
+        Serial.print(F("+CLASS c="));
+        Serial.print(c);
+        Serial.print(F(",share="));
+        Serial.print(mShare[c]);
+        Serial.print(F(",pkts="));
+        Serial.print(mPackets[c]);
+        Serial.print(F(",drops="));
+        Serial.println(mDrops[c]);
+    }
+    for (uint8_t r = 0; r < mRules.numRules(); ++r) {
+        Serial.print(F("+CLASS r="));
+        Serial.print(r);
+        Serial.print(F(",c="));
+        Serial.print(mRuleClass[r]);
+        mRules.printRule(r);
+        Serial.println();
+    }
+}
@@ -0,0 +1,40 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+#ifndef CCSNIFFER_PRIORITYPOLICY_H
+#define CCSNIFFER_PRIORITYPOLICY_H
+
+#include <stdint.h>
+#include "PacketFilter.h"
+
+#define PRIORITY_CLASSES 3
+
+// Drop policy of the processed queue. Packets are class 0 unless a rule puts them higher; every
+// class above 0 reserves a share of the queue that the classes below can't use, so when the
+// queue fills up the lowest class is shed first. A packet is dropped when taking its room would
+// eat into the shares of the classes above; otherwise, if the queue is full, it waits as before.
+class PriorityPolicy {
+public:
+    // Rules take the filter conditions, see PacketFilter; the first matching rule wins
+    bool addRule(uint8_t cls, const char *conditions);
+    // percent of the queue reserved to cls, at most 90 altogether
+    bool setShare(uint8_t cls, uint8_t percent);
+    void clear();
+
+    uint8_t classify(const uint8_t *payload, uint8_t len, uint8_t rssi, bool crcOk);
+
+    // True if a packet of class cls may take size more bytes of a queue with used of capacity taken
+    bool admit(uint8_t cls, uint16_t size, uint16_t used, uint16_t capacity);
+
+    void printStats();
+
+private:
+    PacketFilter mRules;
+    uint8_t mRuleClass[FILTER_MAX_RULES] = {};
+    uint8_t mShare[PRIORITY_CLASSES] = {};
+    uint16_t mPackets[PRIORITY_CLASSES] = {};
+    uint16_t mDrops[PRIORITY_CLASSES] = {};
+};
+
+#endif //CCSNIFFER_PRIORITYPOLICY_H
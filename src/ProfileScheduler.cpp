@@ -0,0 +1,150 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+#include <Arduino.h>
+#include "ProfileScheduler.h"
+#include "cc1101consts.h"
+
+ProfileScheduler::ProfileScheduler(CC1101Tranceiver &radio)
+        : mRadio(radio)
+{
+}
+
+void ProfileScheduler::clear()
+{
+    stop();
+    mNumProfiles = 0;
+}
+
+bool ProfileScheduler::add(const RadioProfile *profile)
+{
+    if (mNumProfiles == SCHEDULER_MAX_PROFILES) {
+        return false;
+    }
+    mSlots[mNumProfiles++].profile = profile;
+    return true;
+}
+
+void ProfileScheduler::start()
+{
+    if (mNumProfiles == 0) {
+        return;
+    }
+
+    noInterrupts();
+    mRadio.setFastHopping(true);
+    interrupts();
+
+    // calibrations take about 1 ms each, keep the receive interrupts off the bus meanwhile
+    for (uint8_t i = 0; i < mNumProfiles; ++i) {
+        Slot &slot = mSlots[i];
+        noInterrupts();
+        mRadio.calibrateProfile(*slot.profile, slot.fscal);
+        interrupts();
+        slot.dwellMs = MIN_DWELL_MS;
+        slot.slots = 0;
+        slot.deferred = 0;
+        slot.hits = 0;
+        slot.switchUs = 0;
+        slot.packets = 0;
+    }
+
+    noInterrupts();
+    mActive = true;
+    switchTo(0);
+    interrupts();
+}
+
+void ProfileScheduler::stop()
+{
+    if (!mActive) {
+        return;
+    }
+
+    noInterrupts();
+    mActive = false;
+    if (mHome != nullptr) {
+        // the home profile goes back to the automatic calibration
+        uint8_t fscal[3];
+        mRadio.calibrateProfile(*mHome, fscal);
+    }
+    mRadio.setFastHopping(false);
+    mRadio.receive();
+    interrupts();
+}
+
+void ProfileScheduler::switchTo(uint8_t index)
+{
+    Slot &slot = mSlots[index];
+    unsigned long start = micros();
+    mRadio.switchProfile(*slot.profile, slot.fscal);
+    slot.switchUs += micros() - start;
+    ++slot.slots;
+
+    mCurrent = index;
+    mSlotPackets = slot.packets;
+    mDeferred = false;
+    mSlotStart = millis();
+}
+
+void ProfileScheduler::poll()
+{
+    if (!mActive || mNumProfiles < 2 || millis() - mSlotStart < mSlots[mCurrent].dwellMs) {
+        return;
+    }
+
+    noInterrupts();
+    Slot &slot = mSlots[mCurrent];
+    if (mRadio.packetPending()) {
+        // keep listening, the packet is counted on this profile
+        if (!mDeferred) {
+            ++slot.deferred;
+            mDeferred = true;
+        }
+        interrupts();
+        return;
+    }
+
+    if (slot.packets != mSlotPackets) {
+        ++slot.hits;
+        slot.dwellMs = slot.dwellMs < MAX_DWELL_MS / 2 ? slot.dwellMs * 2 : MAX_DWELL_MS;
+    } else {
+        uint16_t shorter = slot.dwellMs - slot.dwellMs / 4;
+        slot.dwellMs = shorter > MIN_DWELL_MS ? shorter : MIN_DWELL_MS;
+    }
+
+    switchTo(mCurrent + 1 < mNumProfiles ? mCurrent + 1 : 0);
+    interrupts();
+}
+
+void ProfileScheduler::printStats()
+{
+    for (uint8_t i = 0; i < mNumProfiles; ++i) {
+        Slot &slot = mSlots[i];
+        const uint8_t *regs = slot.profile->regs;
+        uint32_t frf = ((uint32_t) pgm_read_byte(&regs[CC1101_REG_FREQ2]) << 16) |
+                       ((uint16_t) pgm_read_byte(&regs[CC1101_REG_FREQ1]) << 8) |
+                       pgm_read_byte(&regs[CC1101_REG_FREQ0]);
+        noInterrupts();
+        uint16_t packets = slot.packets;
+        interrupts();
+
+        Serial.print(F("+PROF p="));
+        Serial.print(i);
+        Serial.print(F(",freq="));
+        Serial.print(frf, HEX);
+        Serial.print(F(",dwell="));
+        Serial.print(slot.dwellMs);
+        Serial.print(F(",slots="));
+        Serial.print(slot.slots);
+        Serial.print(F(",hits="));
+        Serial.print(slot.hits);
+        Serial.print(F(",defer="));
+        Serial.print(slot.deferred);
+        Serial.print(F(",switch_us="));
+        Serial.print(slot.slots != 0 ? slot.switchUs / slot.slots : 0);
+        Serial.print(F(",pkts="));
+        Serial.println(packets);
+    }
+}
@@ -0,0 +1,81 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+#ifndef CCSNIFFER_PROFILESCHEDULER_H
+#define CCSNIFFER_PROFILESCHEDULER_H
+
+#include <stdint.h>
+#include "cc1101.h"
+#include "RadioProfile.h"
+
+#ifndef SCHEDULER_MAX_PROFILES
+#if defined (BOARD_HUZZAH32)
+#define SCHEDULER_MAX_PROFILES 4
+#else
+#define SCHEDULER_MAX_PROFILES 3
+#endif
+#endif
+
+// Round robin over several radio profiles, for watching protocols with different frequency,
+// bitrate, modulation or sync word with a single radio.
+//
+// The dwell time of each profile adapts to its traffic: it doubles after a slot with packets and
+// shrinks by a quarter after an empty one, between MIN_DWELL_MS and MAX_DWELL_MS. MIN_DWELL_MS is
+// what keeps quiet profiles from being starved by busy ones. The radio never switches while a
+// packet is being received, the slot is extended instead.
+class ProfileScheduler {
+public:
+    static const uint16_t MIN_DWELL_MS = 50;
+    static const uint16_t MAX_DWELL_MS = 400;
+
+    explicit ProfileScheduler(CC1101Tranceiver &radio);
+
+    // Profiles must be in program memory. The home profile is restored by stop().
+    void setHome(const RadioProfile *profile) { mHome = profile; }
+    void clear();
+    bool add(const RadioProfile *profile);
+
+    void start();
+    void stop();
+    bool active() const { return mActive; }
+
+    // From loop(): switches profile once the slot is over
+    void poll();
+
+    // From the receive interrupt, counts the packet on the current profile
+    void packetReceived()
+    {
+        if (mActive) {
+            ++mSlots[mCurrent].packets;
+        }
+    }
+
+    void printStats();
+
+private:
+    struct Slot {
+        const RadioProfile *profile;
+        uint8_t fscal[3];
+        uint16_t dwellMs;
+        uint16_t slots;
+        uint16_t deferred;          // switches postponed by a packet being received
+        uint16_t hits;              // slots with at least a packet
+        uint32_t switchUs;          // total, for the average switch time
+        volatile uint16_t packets;
+    };
+
+    void switchTo(uint8_t index);
+
+    CC1101Tranceiver &mRadio;
+    Slot mSlots[SCHEDULER_MAX_PROFILES];
+    uint8_t mNumProfiles = 0;
+    volatile uint8_t mCurrent = 0;
+    bool mActive = false;
+    bool mDeferred = false;
+    unsigned long mSlotStart = 0;
+    uint16_t mSlotPackets = 0;      // packets of the current profile when its slot started
+    const RadioProfile *mHome = nullptr;
+};
+
+#endif //CCSNIFFER_PROFILESCHEDULER_H
@@ -0,0 +1,186 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+#ifndef CCSNIFFER_PROTOCOLLAYOUT_H
+#define CCSNIFFER_PROTOCOLLAYOUT_H
+
+#include <stdint.h>
+
+#define PROTOCOL_MAX_RECORD 32
+
+// Layouts of known protocols, to send a few fields of their packets instead of the whole payload.
+//
+// A protocol is a match predicate and a list of fields, all template arguments, so that the
+// extractor is straight line code with constant offsets and nothing is interpreted at run time:
+//
+//   using Meter = Protocol<1, ByteIs<0, 0x44>, Field<3, 4>, Field<9, 2, Endian::Big>>;
+//   uint8_t record[Meter::recordSize];
+//   uint8_t n = Meter::extract(payload, len, record);
+//
+// The record is, for every field, its width followed by its value most significant byte first.
+// Functions are single expressions (C++11 constexpr), loops over the lists are written as recursions.
+
+enum class Endian : uint8_t {
+    Little, Big
+};
+
+// WIDTH bytes at OFFSET of the payload
+template<uint8_t OFFSET, uint8_t WIDTH, Endian ENDIAN = Endian::Little>
+struct Field {
+    static_assert(WIDTH >= 1 && WIDTH <= 8, "Field width must be 1 to 8 bytes");
+
+    static constexpr uint8_t end = OFFSET + WIDTH;
+    static constexpr uint8_t recordSize = 1 + WIDTH;
+
+    static uint8_t *copy(const uint8_t *payload, uint8_t *out)
+    {
+        *out++ = WIDTH;
+        for (uint8_t i = 0; i < WIDTH; ++i) {
+            out[i] = payload[ENDIAN == Endian::Big ? OFFSET + i : OFFSET + WIDTH - 1 - i];
+        }
+        return out + WIDTH;
+    }
+};
+
+// Predicates on the payload
+
+// byte at OFFSET, masked, equals VALUE
+template<uint8_t OFFSET, uint8_t VALUE, uint8_t MASK = 0xff>
+struct ByteIs {
+    static_assert((VALUE & ~MASK) == 0, "ByteIs value has bits outside the mask");
+
+    static constexpr uint8_t end = OFFSET + 1;
+
+    // the length is checked against minLength by Protocol::extract()
+    static bool test(const uint8_t *payload, uint8_t)
+    {
+        return (payload[OFFSET] & MASK) == VALUE;
+    }
+};
+
+template<uint8_t MIN, uint8_t MAX = 255>
+struct LengthIn {
+    static constexpr uint8_t end = MIN;
+
+    static bool test(const uint8_t *, uint8_t len)
+    {
+        return len >= MIN && len <= MAX;
+    }
+};
+
+constexpr uint8_t maxOf()
+{
+    return 0;
+}
+
+template<typename... T>
+constexpr uint8_t maxOf(uint8_t first, T... rest)
+{
+    return first > maxOf(rest...) ? first : maxOf(rest...);
+}
+
+constexpr uint8_t sumOf()
+{
+    return 0;
+}
+
+template<typename... T>
+constexpr uint8_t sumOf(uint8_t first, T... rest)
+{
+    return first + sumOf(rest...);
+}
+
+// every predicate holds
+template<typename... P>
+struct All;
+
+template<>
+struct All<> {
+    static constexpr uint8_t end = 0;
+
+    static bool test(const uint8_t *, uint8_t)
+    {
+        return true;
+    }
+};
+
+template<typename P, typename... Rest>
+struct All<P, Rest...> {
+    static constexpr uint8_t end = maxOf(P::end, All<Rest...>::end);
+
+    static bool test(const uint8_t *payload, uint8_t len)
+    {
+        return P::test(payload, len) && All<Rest...>::test(payload, len);
+    }
+};
+
+template<typename... F>
+struct FieldList;
+
+template<>
+struct FieldList<> {
+    static uint8_t *copy(const uint8_t *, uint8_t *out)
+    {
+        return out;
+    }
+};
+
+template<typename F, typename... Rest>
+struct FieldList<F, Rest...> {
+    static uint8_t *copy(const uint8_t *payload, uint8_t *out)
+    {
+        return FieldList<Rest...>::copy(payload, F::copy(payload, out));
+    }
+};
+
+// ID identifies the protocol in the output, 1 to 255
+template<uint8_t ID, typename Match, typename... Fields>
+struct Protocol {
+    static_assert(ID != 0, "Protocol id 0 stands for the raw payload");
+    static_assert(sizeof...(Fields) > 0, "Protocol without fields");
+
+    static constexpr uint8_t id = ID;
+    // payload bytes needed by the predicate and the fields
+    static constexpr uint8_t minLength = maxOf(Match::end, Fields::end...);
+    static constexpr uint8_t recordSize = sumOf(Fields::recordSize...);
+    static_assert(recordSize <= PROTOCOL_MAX_RECORD, "Protocol record too long");
+
+    // Returns the record length, 0 if the packet is not of this protocol
+    static uint8_t extract(const uint8_t *payload, uint8_t len, uint8_t *record)
+    {
+        if (len < minLength || !Match::test(payload, len)) {
+            return 0;
+        }
+        FieldList<Fields...>::copy(payload, record);
+        return recordSize;
+    }
+};
+
+// Tries the protocols in order, the first that matches wins
+template<typename... P>
+struct ProtocolSet;
+
+template<>
+struct ProtocolSet<> {
+    static uint8_t extract(const uint8_t *, uint8_t, uint8_t *, uint8_t &)
+    {
+        return 0;
+    }
+};
+
+template<typename P, typename... Rest>
+struct ProtocolSet<P, Rest...> {
+    // Returns the record length and sets id, 0 if no protocol matches
+    static uint8_t extract(const uint8_t *payload, uint8_t len, uint8_t *record, uint8_t &id)
+    {
+        uint8_t n = P::extract(payload, len, record);
+        if (n != 0) {
+            id = P::id;
+            return n;
+        }
+        return ProtocolSet<Rest...>::extract(payload, len, record, id);
+    }
+};
+
+#endif //CCSNIFFER_PROTOCOLLAYOUT_H
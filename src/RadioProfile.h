@@ -0,0 +1,262 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+#ifndef CCSNIFFER_RADIOPROFILE_H
+#define CCSNIFFER_RADIOPROFILE_H
+
+#include <stdint.h>
+#include "cc1101.h"
+#include "cc1101consts.h"
+#include "LineCode.h"
+
+template<uint8_t... I>
+struct RegisterIndices {};
+
+template<uint8_t N, uint8_t... I>
+struct MakeRegisterIndices : MakeRegisterIndices<N - 1, N - 1, I...> {};
+
+template<uint8_t... I>
+struct MakeRegisterIndices<0, I...> : RegisterIndices<I...> {};
+
+// Image of the configuration registers 0x00 - 0x2E, computed at compile time.
+//
+// Every method returns a copy of the image with one setting applied, with the same arithmetic
+// as the CC1101Tranceiver setters, so that a profile reduces to a constant and the float maths
+// never reaches the target:
+//
+//   const RadioProfile profile PROGMEM = RadioProfile::defaults().frequency(868.3f).bitrate(38.4f);
+//   radio.applyProfile(profile);
+//
+// Functions are single expressions (C++11 constexpr), loops are written as recursions.
+struct RadioProfile {
+    static const uint8_t NumRegisters = CC1101_REG_TEST0 + 1;
+
+    uint8_t regs[NumRegisters];
+    // decoded by the packet handler, not by the chip
+    LineCode coding;
+
+    // Chip reset values
+    static constexpr RadioProfile resetValues()
+    {
+        return RadioProfile{{
+                0x29, 0x2E, 0x3F, 0x07, 0xD3, 0x91, 0xFF, 0x04, 0x45, 0x00, 0x00, 0x0F, 0x00, 0x1E, 0xC4, 0xEC,
+                0x8C, 0x22, 0x02, 0x22, 0xF8, 0x47, 0x07, 0x30, 0x04, 0x36, 0x6C, 0x03, 0x40, 0x91, 0x87, 0x6B,
+                0xF8, 0x56, 0x10, 0xA9, 0x0A, 0x20, 0x0D, 0x41, 0x00, 0x59, 0x7F, 0x3F, 0x88, 0x31, 0x0B
+        }, LineCode::None};
+    }
+
+    // Registers as left by CC1101Tranceiver::initialize()
+    static constexpr RadioProfile defaults()
+    {
+        return resetValues()
+                .set(CC1101_REG_MCSM0, CC1101_FS_AUTOCAL_IDLE_TO_RXTX, 5, 4)
+                .set(CC1101_REG_PKTCTRL1, CC1101_CRC_AUTOFLUSH_OFF | CC1101_APPEND_STATUS_ON | CC1101_ADR_CHK_NONE, 3, 0)
+                .set(CC1101_REG_PKTCTRL0, CC1101_WHITE_DATA_OFF | CC1101_PKT_FORMAT_NORMAL, 6, 4)
+                .set(CC1101_REG_PKTCTRL0, CC1101_CRC_ON | CC1101_LENGTH_CONFIG_VARIABLE, 2, 0)
+                .set(CC1101_REG_FIFOTHR, CC1101_FIFO_THR_TX_33_RX_32, 3, 0)
+                .frequency(868.3f)
+                .bitrate(38.4f)
+                .receiverBW(200.0f)
+                .deviation(20.0f)
+                .modulation(CC1101Tranceiver::Modulation::FSK2)
+                .variablePacketLength()
+                .maximumPacketLength(CC1101_MAX_PACKET_LENGTH)
+                .preambleLength(CC1101Tranceiver::PreambleTypes::Bytes2)
+                .syncWord(0x12, 0xAD);
+    }
+
+    // Masked update of bits msb..lsb, like CC1101Tranceiver::SPIsetRegValue()
+    constexpr RadioProfile set(uint8_t reg, uint8_t value, uint8_t msb = 7, uint8_t lsb = 0) const
+    {
+        return update(reg, fieldMask(msb, lsb), value, MakeRegisterIndices<NumRegisters>());
+    }
+
+    constexpr RadioProfile frequency(float freq) const
+    {
+        return set(CC1101_REG_FREQ2, (frf(freq) & 0xFF0000) >> 16)
+                .set(CC1101_REG_FREQ1, (frf(freq) & 0x00FF00) >> 8)
+                .set(CC1101_REG_FREQ0, frf(freq) & 0x0000FF);
+    }
+
+    constexpr RadioProfile bitrate(float br) const
+    {
+        return bitrate(br * 1000.0, expMantOrigin(256, 28));
+    }
+
+    // An invalid bandwidth leaves the image unchanged, check it with isValidReceiverBW()
+    constexpr RadioProfile receiverBW(float rxBw) const
+    {
+        return receiverBW(findReceiverBW(rxBw, 15));
+    }
+
+    constexpr RadioProfile deviation(float freqDev) const
+    {
+        return deviation((freqDev < 0.0 ? static_cast<float>(1.587) : freqDev) * 1000.0, expMantOrigin(8, 17));
+    }
+
+    constexpr RadioProfile modulation(CC1101Tranceiver::Modulation modulation) const
+    {
+        return set(CC1101_REG_MDMCFG2, modulationFormat(modulation), 6, 4)
+                .set(CC1101_REG_FREND0, modulation == CC1101Tranceiver::Modulation::FSK2 ||
+                                        modulation == CC1101Tranceiver::Modulation::GFSK ? 0 : 1, 2, 0);
+    }
+
+    constexpr RadioProfile syncType(CC1101Tranceiver::SyncType type) const
+    {
+        return set(CC1101_REG_MDMCFG2, static_cast<uint8_t>(type), 2, 0);
+    }
+
+    constexpr RadioProfile preambleLength(CC1101Tranceiver::PreambleTypes type) const
+    {
+        return set(CC1101_REG_MDMCFG1, static_cast<uint8_t>(type) << 4, 6, 4);
+    }
+
+    constexpr RadioProfile syncWord(uint8_t w1, uint8_t w2) const
+    {
+        return set(CC1101_REG_SYNC1, w1).set(CC1101_REG_SYNC0, w2);
+    }
+
+    constexpr RadioProfile crc(bool enable) const
+    {
+        return set(CC1101_REG_PKTCTRL0, enable ? CC1101_CRC_ON : 0, 2, 2);
+    }
+
+    constexpr RadioProfile whitening(bool enable) const
+    {
+        return set(CC1101_REG_PKTCTRL0, enable ? CC1101_WHITE_DATA_ON : CC1101_WHITE_DATA_OFF, 6, 6);
+    }
+
+    constexpr RadioProfile variablePacketLength() const
+    {
+        return set(CC1101_REG_PKTCTRL0, CC1101_LENGTH_CONFIG_VARIABLE, 1, 0);
+    }
+
+    constexpr RadioProfile maximumPacketLength(uint8_t max) const
+    {
+        return set(CC1101_REG_PKTLEN, max);
+    }
+
+    // Line code of the payload after the length byte, see LineCode.h
+    constexpr RadioProfile lineCode(LineCode code) const
+    {
+        return withCoding(code, MakeRegisterIndices<NumRegisters>());
+    }
+
+    static constexpr bool isValidFrequency(float freq)
+    {
+        return ((freq > 300.0) && (freq < 348.0)) ||
+               ((freq > 387.0) && (freq < 464.0)) ||
+               ((freq > 779.0) && (freq < 928.0));
+    }
+
+    static constexpr bool isValidReceiverBW(float rxBw)
+    {
+        return findReceiverBW(rxBw, 15) >= 0;
+    }
+
+    // FREQ2:FREQ1:FREQ0 for a carrier frequency in MHz
+    static constexpr uint32_t frf(float freq)
+    {
+        return (freq * ((uint32_t) 1 << 16)) / CC1101_CRYSTAL_FREQ;
+    }
+
+    // Carrier frequency in Hz for FREQ2:FREQ1:FREQ0, f_xosc / 2^16 = 1625000 / 4096 Hz
+    static constexpr uint32_t frequencyHz(uint32_t frf)
+    {
+        return ((uint64_t) frf * 1625000) >> 12;
+    }
+
+    // Channel spacing in Hz for CHANSPC_E, CHANSPC_M, f_xosc / 2^18 = 203125 / 2048 Hz
+    static constexpr uint32_t channelSpacingHz(uint8_t e, uint8_t m)
+    {
+        return (((uint32_t) 256 + m) << e) * 203125 >> 11;
+    }
+
+private:
+    static constexpr uint8_t fieldMask(uint8_t msb, uint8_t lsb)
+    {
+        return ~((0b11111111 << (msb + 1)) | (0b11111111 >> (8 - lsb)));
+    }
+
+    template<uint8_t... I>
+    constexpr RadioProfile update(uint8_t reg, uint8_t mask, uint8_t value, RegisterIndices<I...>) const
+    {
+        return RadioProfile{{static_cast<uint8_t>(I == reg ? (regs[I] & ~mask) | (value & mask) : regs[I])...}, coding};
+    }
+
+    template<uint8_t... I>
+    constexpr RadioProfile withCoding(LineCode code, RegisterIndices<I...>) const
+    {
+        return RadioProfile{{regs[I]...}, code};
+    }
+
+    // The exponent/mantissa tables of bitrate and deviation, see getExpMant() in cc1101.cpp
+    static constexpr float expMantOrigin(uint16_t mantOffset, uint8_t divExp)
+    {
+        return (mantOffset * CC1101_CRYSTAL_FREQ * 1000000.0) / ((uint32_t) 1 << divExp);
+    }
+
+    static constexpr float intervalStart(float origin, int8_t e)
+    {
+        return ((uint32_t) 1 << e) * origin;
+    }
+
+    // first exponent from e down whose column holds target, -1 if none
+    static constexpr int8_t findExp(float target, float origin, int8_t e)
+    {
+        return e < 0 ? -1 : target >= intervalStart(origin, e) ? e : findExp(target, origin, e - 1);
+    }
+
+    static constexpr uint8_t exponent(int8_t e)
+    {
+        return e < 0 ? 0 : e;
+    }
+
+    static constexpr uint8_t mantissa(float target, float origin, uint16_t mantOffset, int8_t e)
+    {
+        return e < 0 ? 0 : static_cast<uint8_t>((target - intervalStart(origin, e)) /
+                                                (intervalStart(origin, e) / (float) mantOffset));
+    }
+
+    constexpr RadioProfile bitrate(float target, float origin) const
+    {
+        return set(CC1101_REG_MDMCFG4, exponent(findExp(target, origin, 14)), 3, 0)
+                .set(CC1101_REG_MDMCFG3, mantissa(target, origin, 256, findExp(target, origin, 14)));
+    }
+
+    constexpr RadioProfile deviation(float target, float origin) const
+    {
+        return set(CC1101_REG_DEVIATN, exponent(findExp(target, origin, 7)) << 4, 6, 4)
+                .set(CC1101_REG_DEVIATN, mantissa(target, origin, 8, findExp(target, origin, 7)), 2, 0);
+    }
+
+    // Receiver bandwidth settings are tried from e = 3, m = 3 down, index = e * 4 + m
+    static constexpr float receiverBWPoint(int8_t index)
+    {
+        return (CC1101_CRYSTAL_FREQ * 1000000.0) / (8 * ((index & 3) + 4) * ((uint32_t) 1 << (index >> 2)));
+    }
+
+    static constexpr int8_t findReceiverBW(float rxBw, int8_t index)
+    {
+        return index < 0 ? -1
+                         : ((rxBw < 0 ? -rxBw : rxBw) * 1000.0 - receiverBWPoint(index)) <= 1000 ? index
+                         : findReceiverBW(rxBw, index - 1);
+    }
+
+    constexpr RadioProfile receiverBW(int8_t index) const
+    {
+        return index < 0 ? *this : set(CC1101_REG_MDMCFG4, ((index >> 2) << 6) | ((index & 3) << 4), 7, 4);
+    }
+
+    static constexpr uint8_t modulationFormat(CC1101Tranceiver::Modulation modulation)
+    {
+        return modulation == CC1101Tranceiver::Modulation::GFSK ? CC1101_MOD_FORMAT_GFSK
+             : modulation == CC1101Tranceiver::Modulation::ASK_OOK ? CC1101_MOD_FORMAT_ASK_OOK
+             : modulation == CC1101Tranceiver::Modulation::FSK4 ? CC1101_MOD_FORMAT_4_FSK
+             : modulation == CC1101Tranceiver::Modulation::MFSK ? CC1101_MOD_FORMAT_MFSK
+             : CC1101_MOD_FORMAT_2_FSK;
+    }
+};
+
+#endif //CCSNIFFER_RADIOPROFILE_H
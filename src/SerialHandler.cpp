@@ -13,6 +13,10 @@ SerialHandler::SerialHandler()
 
 void SerialHandler::init()
 {
+#if defined (BOARD_HUZZAH32)
+    // the UART driver drains its own TX ring, make it large; on AVR see SERIAL_TX_BUFFER_SIZE
+    Serial.setTxBufferSize(SERIAL_TX_RING_SIZE);
+#endif
     Serial.begin(38400);
 
 }
@@ -45,19 +49,66 @@ bool SerialHandler::readIncoming()
 
         if (mSerialLen < MAXSERIAL-1)
             ++mSerialLen;
+        else
+            mTruncated = true;
     }
     return false;
 }
 
-int SerialHandler::copyLine(char *buffer, int maxlen)
+char *SerialHandler::line()
+{
+    // the CR is never counted, mSerialLen stays below MAXSERIAL
+    mSerialBuf[mSerialLen] = '\0';
+    return mSerialBuf;
+}
+
+void SerialHandler::nextLine()
 {
-    int l = mSerialLen;
-    if (l > maxlen)
-        l = maxlen;
-    memcpy(buffer, mSerialBuf, l);
     mSerialLen=0;
     mAvailable=false;
+    mTruncated=false;
+}
+
 
-    return l;
+namespace {
+// names and table in program memory, on AVR they would otherwise be copied to RAM at startup
+struct CommandName {
+    char name[8];
+    SerialCommand command;
+};
+
+const CommandName commands[] PROGMEM = {
+        {"+STATS", SerialCommand::Stats},
+        {"+HIST", SerialCommand::Histogram},
+        {"+BENCH", SerialCommand::Benchmark},
+        {"+REGS", SerialCommand::Registers},
+        {"+SCAN", SerialCommand::Scan},
+        {"+PROF", SerialCommand::Profiles},
+        {"+SWEEP", SerialCommand::Sweep},
+        {"+STOP", SerialCommand::Stop},
+        {"+FILTER", SerialCommand::Filter},
+        {"+DEDUP", SerialCommand::Dedup},
+        {"+CLASS", SerialCommand::Classes},
+        {"+FIELDS", SerialCommand::Fields},
+        {"+BIN", SerialCommand::Binary},
+        {"+TEXT", SerialCommand::Text},
+};
 }
 
+SerialCommand SerialHandler::parseCommand(const char *line, const char **args)
+{
+    *args = line;
+    if (line[0] != '+') {
+        return SerialCommand::Transmit;
+    }
+
+    for (auto &c : commands) {
+        size_t l = strlen_P(c.name);
+        if (strncmp_P(line, c.name, l) == 0 && (line[l] == '\0' || line[l] == ' ')) {
+            *args = line[l] == ' ' ? &line[l + 1] : &line[l];
+            return static_cast<SerialCommand>(pgm_read_byte(&c.command));
+        }
+    }
+
+    return SerialCommand::Unknown;
+}
@@ -7,12 +7,44 @@
 
 #include <stdint.h>
 
+// A line carries a packet to transmit in hex: up to 254 bytes on the ESP32, 63 on the Nano
+#if defined (BOARD_HUZZAH32)
+#define MAXSERIAL 512
+#else
 #define MAXSERIAL 128
+#endif
+
+// The output goes through a TX ring drained by the UART interrupt: the ESP32 UART driver ring,
+// sized here, or on AVR the HardwareSerial ring, sized by SERIAL_TX_BUFFER_SIZE in platformio.ini.
+#ifndef SERIAL_TX_RING_SIZE
+#define SERIAL_TX_RING_SIZE 4096
+#endif
+
+// Lines starting with '+' are commands, anything else is a hex packet to transmit
+enum class SerialCommand : uint8_t {
+    Transmit,
+    Stats,
+    Histogram,
+    Benchmark,
+    Registers,
+    Scan,
+    Profiles,
+    Sweep,
+    Filter,
+    Dedup,
+    Classes,
+    Fields,
+    Binary,
+    Text,
+    Stop,
+    Unknown
+};
 
 class SerialHandler {
     char mSerialBuf[MAXSERIAL];
-    uint8_t mSerialLen = 0;
+    uint16_t mSerialLen = 0;
     bool mAvailable = false;
+    bool mTruncated = false;
 
     bool readIncoming();
 public:
@@ -22,7 +54,14 @@ public:
 
     bool lineAvailable() ;
 
-    int copyLine(char *buffer, int maxlen);
+    // The line, NUL terminated in place: no copy, it stays valid until nextLine()
+    char *line();
+    void nextLine();
+    // The line was longer than the buffer, its end is lost
+    bool truncated() const { return mTruncated; }
+
+    // Returns the command in line, args points to its arguments (the hex string for Transmit)
+    static SerialCommand parseCommand(const char *line, const char **args);
 };
 
 
@@ -0,0 +1,82 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+#ifndef CCSNIFFER_SPSCRING_H
+#define CCSNIFFER_SPSCRING_H
+
+#include <stdint.h>
+
+// Orders the slot accesses against the publication of the indices.
+// On AVR there is a single core and 8 bit loads/stores are atomic, so only the compiler must be stopped.
+#if defined (__AVR__)
+#define SPSC_BARRIER() __asm__ __volatile__("" ::: "memory")
+#else
+#define SPSC_BARRIER() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
+
+/*
+ * Lock free single producer / single consumer ring, meant for the ISR -> loop() handoff.
+ * The producer only writes head, the consumer only writes tail, so neither side has to mask interrupts.
+ * Indices are free running 8 bit counters, masked on access: all N slots are usable.
+ */
+template <typename T, int N>
+class SpscRing {
+    static_assert(N >= 2 && N <= 128 && (N & (N - 1)) == 0, "SpscRing length must be a power of two, up to 128");
+    static const uint8_t MASK = N - 1;
+
+    T ring[N];
+    volatile uint8_t head = 0;
+    volatile uint8_t tail = 0;
+
+public:
+    SpscRing() = default;
+
+    bool empty() const {
+        return head == tail;
+    }
+
+    bool full() const {
+        return static_cast<uint8_t>(head - tail) == N;
+    }
+
+    uint8_t size() const {
+        return head - tail;
+    }
+
+    static constexpr uint8_t capacity() {
+        return N;
+    }
+
+    // Producer side
+    T *reserve() {
+        uint8_t h = head;
+        if (static_cast<uint8_t>(h - tail) == N) {
+            return nullptr;
+        }
+        SPSC_BARRIER();
+        return &ring[h & MASK];
+    }
+
+    void commit() {
+        SPSC_BARRIER();
+        head = head + 1;
+    }
+
+    // Consumer side
+    T *peek() {
+        uint8_t t = tail;
+        if (head == t) {
+            return nullptr;
+        }
+        SPSC_BARRIER();
+        return &ring[t & MASK];
+    }
+
+    void release() {
+        SPSC_BARRIER();
+        tail = tail + 1;
+    }
+};
+
+#endif //CCSNIFFER_SPSCRING_H
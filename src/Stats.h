@@ -0,0 +1,52 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+#ifndef CCSNIFFER_STATS_H
+#define CCSNIFFER_STATS_H
+
+#include <stdint.h>
+
+// Per stage counters of the receive pipeline, dumped by the +STATS command.
+// Counters wrap around, host tools are expected to compute differences.
+struct PipelineStats {
+    // written by the interrupt handlers
+    volatile uint16_t syncIrq = 0;          // sync words detected
+    volatile uint16_t fifoDrains = 0;       // RX FIFO burst reads (threshold and end of packet)
+    volatile uint16_t rawDropped = 0;       // packets lost because the raw queue was full
+    volatile uint16_t rxOverflow = 0;       // RX FIFO overflows
+    volatile uint16_t rxTimeout = 0;        // end of packet without data
+    volatile uint16_t txUnderflows = 0;     // packets cut short by a TX FIFO underflow
+
+    // written by loop()
+    uint16_t processedStalls = 0;           // raw packets held back because the processed queue was full
+    uint16_t crcErrors = 0;
+    uint16_t codingErrors = 0;              // packets with an invalid line code word
+    uint16_t filtered = 0;                  // packets rejected by the filter rules
+    uint16_t serialBacklog = 0;             // packets that waited for room in the serial TX buffer
+};
+
+// log2 histogram of the latency between the sync word interrupt and the serial output of the packet.
+// Bucket n counts latencies in [2^n, 2^(n+1)) microseconds, bucket 0 also counts 0 and the last one
+// also counts the longer latencies: on AVR it starts at 8 s, to save RAM.
+struct LatencyHistogram {
+#if defined (__AVR__)
+    static const uint8_t BUCKETS = 24;
+#else
+    static const uint8_t BUCKETS = 32;
+#endif
+    uint16_t buckets[BUCKETS] = {};
+
+    void add(uint32_t us) {
+        uint8_t n = 0;
+        while (us > 1 && n < BUCKETS - 1) {
+            us >>= 1;
+            ++n;
+        }
+        if (buckets[n] != 0xffff) {
+            ++buckets[n];
+        }
+    }
+};
+
+#endif //CCSNIFFER_STATS_H
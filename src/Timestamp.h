@@ -0,0 +1,115 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+#ifndef CCSNIFFER_TIMESTAMP_H
+#define CCSNIFFER_TIMESTAMP_H
+
+#include <Arduino.h>
+#include <stdint.h>
+
+// 48 bit microseconds timestamp, about 8.9 years before rolling over
+struct Timestamp {
+    uint32_t low = 0;
+    uint16_t high = 0;
+};
+
+// micros() extended with a rollover counter. now() must be called at least once every ~71 minutes,
+// and never concurrently: call it from interrupt handlers or with interrupts disabled.
+class MicrosClock {
+    uint32_t mLast = 0;
+    uint16_t mHigh = 0;
+
+public:
+    Timestamp now() {
+        Timestamp t;
+        t.low = micros();
+        if (t.low < mLast) {
+            ++mHigh;
+        }
+        mLast = t.low;
+        t.high = mHigh;
+        return t;
+    }
+};
+
+// Sequence numbers and timestamps latched on the sync word interrupts, oldest first, until the
+// packets they belong to take them once their length byte is read. That may be after the sync of
+// the next packet, when its end of packet interrupt is served late. Interrupt handlers only, like
+// MicrosClock::now(). When full the oldest stamp is dropped.
+template <uint8_t N>
+class SyncStamps {
+public:
+    struct Stamp {
+        uint16_t sequence;
+        Timestamp timestamp;
+    };
+
+    void latch(uint16_t sequence, const Timestamp &timestamp) {
+        if (mCount == N) {
+            drop();
+        }
+        Stamp &stamp = mStamps[(mFirst + mCount) % N];
+        stamp.sequence = sequence;
+        stamp.timestamp = timestamp;
+        ++mCount;
+    }
+
+    // The oldest stamp, false if there is none
+    bool take(Stamp &stamp) {
+        if (mCount == 0) {
+            return false;
+        }
+        stamp = mStamps[mFirst];
+        drop();
+        return true;
+    }
+
+    // Drops the oldest stamp, its sync word ended without a packet
+    void drop() {
+        if (mCount != 0) {
+            mFirst = (mFirst + 1) % N;
+            --mCount;
+        }
+    }
+
+    // Keeps the latest count stamps at most
+    void keep(uint8_t count) {
+        while (mCount > count) {
+            drop();
+        }
+    }
+
+    uint8_t size() const { return mCount; }
+
+private:
+    Stamp mStamps[N];
+    uint8_t mFirst = 0;
+    uint8_t mCount = 0;
+};
+
+// Formats the timestamp in decimal, buffer must hold at least 16 chars. Returns the string length.
+inline uint8_t formatTimestamp(const Timestamp &t, char *buffer)
+{
+    // long division by 10 on 16 bit digits, avoids the 64 bit arithmetic helpers on AVR
+    uint16_t digits[3] = {t.high, static_cast<uint16_t>(t.low >> 16), static_cast<uint16_t>(t.low & 0xffff)};
+    char reversed[16];
+    uint8_t n = 0;
+    do {
+        uint32_t remainder = 0;
+        for (auto &d : digits) {
+            uint32_t v = (remainder << 16) | d;
+            d = v / 10;
+            remainder = v % 10;
+        }
+        reversed[n++] = '0' + remainder;
+    } while (digits[0] != 0 || digits[1] != 0 || digits[2] != 0);
+
+    for (uint8_t i = 0; i < n; ++i) {
+        buffer[i] = reversed[n - 1 - i];
+    }
+    buffer[n] = '\0';
+    return n;
+}
+
+#endif //CCSNIFFER_TIMESTAMP_H
@@ -6,27 +6,45 @@
 #include <Arduino.h>
 #include "cc1101.h"
 #include "cc1101consts.h"
+#include "RadioProfile.h"
 
 static const uint8_t SPIreadCommand = CC1101_CMD_READ;
 static const uint8_t SPIwriteCommand = CC1101_CMD_WRITE;
 
+static const uint8_t RxBytesOverflow = 0xff;
+
+static const RadioProfile defaultProfile PROGMEM = RadioProfile::defaults();
+
 [[noreturn]]
-static void fail(const char *msg)
+static void fail(const __FlashStringHelper *msg)
 {
-    Serial.print("FATAL: ");
+    Serial.print(F("FATAL: "));
     Serial.print(msg);
     while (true) {}
 }
 
 CC1101Tranceiver::CC1101Tranceiver(uint8_t cs, uint8_t gdo0, uint8_t gdo2, uint8_t rst)
         : _cs(cs), _gdo0(gdo0), _gdo2(gdo2), _rst(rst),
+#ifdef CC1101_ESP32_SPI
+          // below the 6.5 MHz the CC1101 allows for bursts without delays between bytes
+          _spiSettings(SPISettings(6000000, MSBFIRST, SPI_MODE0)),
+#else
           _spiSettings(SPISettings(2000000, MSBFIRST, SPI_MODE0)),
+#endif
           _spi(SPI)
 {
-
+#ifdef CC1101_AVR_SPI
+    mCsPort = portOutputRegister(digitalPinToPort(cs));
+    mCsMask = digitalPinToBitMask(cs);
+#endif
 }
 
 int CC1101Tranceiver::initialize()
+{
+    return initialize(defaultProfile);
+}
+
+int CC1101Tranceiver::initialize(const RadioProfile &profile)
 {
     detachInterrupt(digitalPinToInterrupt(_gdo0));
     detachInterrupt(digitalPinToInterrupt(_gdo2));
@@ -43,24 +61,9 @@ int CC1101Tranceiver::initialize()
         return -1;
     }
 
-    standby();
-
-    SPIsetRegValue(CC1101_REG_MCSM0, CC1101_FS_AUTOCAL_IDLE_TO_RXTX, 5, 4);
-    SPIsetRegValue(CC1101_REG_PKTCTRL1, CC1101_CRC_AUTOFLUSH_OFF | CC1101_APPEND_STATUS_ON | CC1101_ADR_CHK_NONE, 3, 0);
-    SPIsetRegValue(CC1101_REG_PKTCTRL0, CC1101_WHITE_DATA_OFF | CC1101_PKT_FORMAT_NORMAL, 6, 4);
-    SPIsetRegValue(CC1101_REG_PKTCTRL0, CC1101_CRC_ON | CC1101_LENGTH_CONFIG_VARIABLE, 2, 0);
-    SPIsetRegValue(CC1101_REG_FIFOTHR, 0x0d, 3, 0);
-
-    setFrequency(868.3f);
-    setBitrate(38.4);
-    setReceiverBW(200.0);
-    setDeviation(20.0);
-    setOutputPower(-30);    // minimum allowed power
-    setModulation(Modulation::FSK2);
-    setVariablePacketLength();
-    setMaximumPacketLength(63);
-    setPreambleLength(PreambleTypes::Bytes2);
-    setSyncWord(0x12, 0xAD);
+    mPower = -30;    // minimum allowed power
+    applyProfile(profile);
+    mVariableLength = true;
 
     SPIsendCommand(CC1101_CMD_FLUSH_RX);
     SPIsendCommand(CC1101_CMD_FLUSH_TX);
@@ -68,8 +71,26 @@ int CC1101Tranceiver::initialize()
     return 0;
 }
 
+bool CC1101Tranceiver::waitChipReady()
+{
+    // with CS low the chip holds SO high until its crystal is running and it is ready (CHIP_RDYn)
+    const unsigned long timeoutUs = 10000;
+
+    digitalWrite(_cs, LOW);
+    unsigned long start = micros();
+    bool ready;
+    while (!(ready = digitalRead(MISO) == LOW) && micros() - start < timeoutUs) {}
+    digitalWrite(_cs, HIGH);
+
+    return ready;
+}
+
 bool CC1101Tranceiver::findChip()
 {
+    if (!waitChipReady()) {
+        return false;
+    }
+
     uint8_t version;
     int i = 0;
     while (true) {
@@ -91,10 +112,10 @@ bool CC1101Tranceiver::findChip()
     Serial.println();
 #endif
 
-    SPIsendCommand(CC1101_CMD_RESET);
-    delay(150);
-
-    return true;
+    // the reset is over when the chip is ready again; the caller then writes the whole
+    // configuration, so the shadow isn't loaded from the chip
+    SPIstrobe(CC1101_CMD_RESET);
+    return waitChipReady();
 }
 
 uint16_t CC1101Tranceiver::getChipVersion()
@@ -104,36 +125,54 @@ uint16_t CC1101Tranceiver::getChipVersion()
 
 uint16_t CC1101Tranceiver::SPIgetRegValue(uint8_t reg, uint8_t msb, uint8_t lsb)
 {
-    if (reg > CC1101_REG_TEST0) {
-        reg |= CC1101_CMD_ACCESS_STATUS_REG;
-    }
-
     if ((msb > 7) || (lsb > 7) || (lsb > msb)) {
-        fail("invalid bit range");
+        fail(F("invalid bit range"));
     }
 
-    uint8_t rawValue = SPIreadRegister(reg);
+    uint8_t rawValue;
+    if (isShadowed(reg)) {
+        rawValue = mShadow[reg];
+#ifdef CC1101_VERIFY_REGISTERS
+        if (!isDirty(reg) && SPIreadRegister(reg) != rawValue) {
+            ++mRegisterMismatches;
+        }
+#endif
+    } else {
+        rawValue = SPIreadRegister(reg);
+    }
     uint8_t maskedValue = rawValue & ((0b11111111 << lsb) & (0b11111111 >> (7 - msb)));
     return (maskedValue);
 }
 
-uint16_t CC1101Tranceiver::SPIsetRegValue(uint8_t reg, uint8_t value, uint8_t msb, uint8_t lsb, uint8_t checkInterval)
+uint16_t CC1101Tranceiver::SPIsetRegValue(uint8_t reg, uint8_t value, uint8_t msb, uint8_t lsb)
 {
+    uint8_t mask = ~((0b11111111 << (msb + 1)) | (0b11111111 >> (8 - lsb)));
+
+    if (isShadowed(reg)) {
+        // only the shadow is updated, the chip gets it with the next flush
+        uint8_t newValue = (mShadow[reg] & ~mask) | (value & mask);
+        if (newValue != mShadow[reg]) {
+            mShadow[reg] = newValue;
+            mDirty[reg / 8] |= 1 << (reg % 8);
+            mRegistersDirty = true;
+        }
+        return (0);
+    }
+
     if (reg > CC1101_REG_TEST0) {
         reg |= CC1101_CMD_ACCESS_STATUS_REG;
     }
 
     uint8_t currentValue = SPIreadRegister(reg);
-    uint8_t mask = ~((0b11111111 << (msb + 1)) | (0b11111111 >> (8 - lsb)));
     uint8_t newValue = (currentValue & ~mask) | (value & mask);
     SPIwriteRegister(reg, newValue);
 
     return (0);
 }
 
-void CC1101Tranceiver::SPIreadRegisterBurst(uint8_t reg, uint8_t numBytes, uint8_t *inBytes)
+uint8_t CC1101Tranceiver::SPIreadRegisterBurst(uint8_t reg, uint8_t numBytes, uint8_t *inBytes)
 {
-    SPItransfer(SPIreadCommand, reg | CC1101_CMD_BURST, nullptr, inBytes, numBytes);
+    return SPItransfer(SPIreadCommand, reg | CC1101_CMD_BURST, nullptr, inBytes, numBytes);
 }
 
 uint8_t CC1101Tranceiver::SPIreadRegister(uint8_t reg)
@@ -149,6 +188,12 @@ uint8_t CC1101Tranceiver::SPIreadRegister(uint8_t reg)
 
 void CC1101Tranceiver::SPIwriteRegister(uint8_t reg, uint8_t data)
 {
+    // write through, the shadow stays in sync
+    if (reg <= CC1101_REG_TEST0) {
+        mShadow[reg] = data;
+        mDirty[reg / 8] &= ~(1 << (reg % 8));
+    }
+
     // status registers require special command
     if (reg > CC1101_REG_TEST0) {
         reg |= CC1101_CMD_ACCESS_STATUS_REG;
@@ -157,32 +202,214 @@ void CC1101Tranceiver::SPIwriteRegister(uint8_t reg, uint8_t data)
     SPItransfer(SPIwriteCommand, reg, &data, nullptr, 1);
 }
 
-void CC1101Tranceiver::SPIwriteRegisterBurst(uint8_t reg, uint8_t *data, size_t len)
+uint8_t CC1101Tranceiver::SPIwriteRegisterBurst(uint8_t reg, const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len && reg + i <= CC1101_REG_TEST0; ++i) {
+        mShadow[reg + i] = data[i];
+        mDirty[(reg + i) / 8] &= ~(1 << ((reg + i) % 8));
+    }
+    return SPItransfer(SPIwriteCommand, reg | CC1101_CMD_BURST, data, nullptr, len);
+}
+
+uint8_t CC1101Tranceiver::SPIsendCommand(uint8_t cmd)
+{
+    // the chip must see the configuration before doing anything with it
+    if (mRegistersDirty && cmd != CC1101_CMD_NOP) {
+        flushRegisters();
+    }
+    return SPIstrobe(cmd);
+}
+
+bool CC1101Tranceiver::isShadowed(uint8_t reg) const
+{
+    // the synthesizer calibration results are written by the chip itself
+    return reg <= CC1101_REG_TEST0 && (reg < CC1101_REG_FSCAL3 || reg > CC1101_REG_FSCAL1);
+}
+
+bool CC1101Tranceiver::isDirty(uint8_t reg) const
 {
-    SPItransfer(SPIwriteCommand, reg | CC1101_CMD_BURST, data, nullptr, len);
+    return mDirty[reg / 8] & (1 << (reg % 8));
 }
 
-void CC1101Tranceiver::SPIsendCommand(uint8_t cmd)
+void CC1101Tranceiver::flushRegisters()
+{
+    // Dirty registers go out in bursts. A burst carries on over a couple of clean registers,
+    // rewriting their value costs less than the header and chip select of a new one.
+    const uint8_t maxGap = 2;
+
+    mRegistersDirty = false;
+    uint8_t reg = 0;
+    while (reg <= CC1101_REG_TEST0) {
+        if (!isDirty(reg)) {
+            ++reg;
+            continue;
+        }
+
+        uint8_t last = reg;
+        for (uint8_t r = reg + 1; r <= CC1101_REG_TEST0 && r - last <= maxGap + 1 && isShadowed(r); ++r) {
+            if (isDirty(r)) {
+                last = r;
+            }
+        }
+
+        uint8_t len = last - reg + 1;
+        SPItransfer(SPIwriteCommand, reg | CC1101_CMD_BURST, &mShadow[reg], nullptr, len);
+#ifdef CC1101_VERIFY_REGISTERS
+        uint8_t readBack[CC1101_REG_TEST0 + 1];
+        SPIreadRegisterBurst(reg, len, readBack);
+        for (uint8_t i = 0; i < len; ++i) {
+            if (readBack[i] != mShadow[reg + i]) {
+                ++mRegisterMismatches;
+            }
+        }
+#endif
+        for (uint8_t r = reg; r <= last; ++r) {
+            mDirty[r / 8] &= ~(1 << (r % 8));
+        }
+        reg = last + 1;
+    }
+}
+
+#ifdef CC1101_AVR_SPI
+
+// The CC1101 accepts up to 10 MHz SCLK for single accesses and 6.5 MHz for bursts without
+// delays between bytes: fosc/2 and fosc/4, i.e. 8 and 4 MHz on the 16 MHz Nano.
+static inline void avrSpiSingle()
+{
+    SPCR = _BV(SPE) | _BV(MSTR);
+    SPSR = _BV(SPI2X);
+}
+
+static inline void avrSpiBurst()
+{
+    SPCR = _BV(SPE) | _BV(MSTR);
+    SPSR = 0;
+}
+
+static inline uint8_t avrSpiTransfer(uint8_t data)
+{
+    SPDR = data;
+    while (!(SPSR & _BV(SPIF))) {}
+    return SPDR;
+}
+
+uint8_t CC1101Tranceiver::SPIstrobe(uint8_t cmd)
+{
+    avrSpiSingle();
+    *mCsPort &= ~mCsMask;
+    uint8_t status = avrSpiTransfer(cmd);
+    *mCsPort |= mCsMask;
+    ++mSpiTransactions;
+
+    return status;
+}
+
+uint8_t CC1101Tranceiver::SPItransfer(uint8_t cmd, uint8_t reg, const uint8_t *dataOut, uint8_t *dataIn, uint8_t numBytes)
+{
+    if (reg & CC1101_CMD_BURST) {
+        avrSpiBurst();
+    } else {
+        avrSpiSingle();
+    }
+
+    *mCsPort &= ~mCsMask;
+    uint8_t status = avrSpiTransfer(reg | cmd);
+
+    if (cmd == SPIwriteCommand) {
+        if (dataOut != nullptr) {
+            for (uint8_t n = 0; n < numBytes; n++) {
+                avrSpiTransfer(dataOut[n]);
+            }
+        }
+    } else if (cmd == SPIreadCommand) {
+        if (dataIn != nullptr) {
+            for (uint8_t n = 0; n < numBytes; n++) {
+                dataIn[n] = avrSpiTransfer(0x00);
+            }
+        }
+    }
+
+    *mCsPort |= mCsMask;
+    ++mSpiTransactions;
+
+    return status;
+}
+
+#else
+
+uint8_t CC1101Tranceiver::SPIstrobe(uint8_t cmd)
 {
     digitalWrite(_cs, LOW);
 
     // start transfer
     _spi.beginTransaction(_spiSettings);
 
-    // send the command byte
-    _spi.transfer(cmd);
+    // send the command byte, the chip answers with its status
+    uint8_t status = _spi.transfer(cmd);
+    ++mSpiTransactions;
 
     // stop transfer
     _spi.endTransaction();
     digitalWrite(_cs, HIGH);
+
+    return status;
 }
 
-void CC1101Tranceiver::SPItransfer(uint8_t cmd, uint8_t reg, uint8_t *dataOut, uint8_t *dataIn, uint8_t numBytes)
+#ifdef CC1101_ESP32_SPI
+
+uint8_t CC1101Tranceiver::SPItransfer(uint8_t cmd, uint8_t reg, const uint8_t *dataOut, uint8_t *dataIn, uint8_t numBytes)
+{
+    // The header and the data are chained in one buffer and clocked out with a single block
+    // transfer, so that a configuration burst or a FIFO drain is one operation of the 64 bytes
+    // peripheral buffer rather than a library call per byte.
+    uint8_t buffer[1 + CC1101_FIFO_SIZE];
+    buffer[0] = reg | cmd;
+    uint8_t status = 0;
+
+    _spi.beginTransaction(_spiSettings);
+    digitalWrite(_cs, LOW);
+
+    uint8_t offset = 1;
+    uint8_t done = 0;
+    do {
+        uint8_t chunk = numBytes - done;
+        if (chunk > sizeof(buffer) - offset) {
+            chunk = sizeof(buffer) - offset;
+        }
+
+        if (cmd == SPIwriteCommand && dataOut != nullptr) {
+            memcpy(&buffer[offset], &dataOut[done], chunk);
+        } else {
+            memset(&buffer[offset], 0, chunk);
+        }
+        _spi.transferBytes(buffer, buffer, offset + chunk);
+        if (offset != 0) {
+            status = buffer[0];
+        }
+        if (cmd == SPIreadCommand && dataIn != nullptr) {
+            memcpy(&dataIn[done], &buffer[offset], chunk);
+        }
+
+        done += chunk;
+        offset = 0;
+    } while (done < numBytes);
+
+    digitalWrite(_cs, HIGH);
+    _spi.endTransaction();
+    ++mSpiTransactions;
+
+    return status;
+}
+
+#else
+
+uint8_t CC1101Tranceiver::SPItransfer(uint8_t cmd, uint8_t reg, const uint8_t *dataOut, uint8_t *dataIn, uint8_t numBytes)
 {
     _spi.beginTransaction(_spiSettings);
 
     digitalWrite(_cs, LOW);
-    _spi.transfer(reg | cmd);
+    uint8_t status = _spi.transfer(reg | cmd);
+    ++mSpiTransactions;
 
     if (cmd == SPIwriteCommand) {
         if (dataOut != nullptr) {
@@ -200,28 +427,32 @@ void CC1101Tranceiver::SPItransfer(uint8_t cmd, uint8_t reg, uint8_t *dataOut, u
 
     digitalWrite(_cs, HIGH);
     _spi.endTransaction();
+
+    return status;
 }
 
+#endif // CC1101_ESP32_SPI
+
+#endif
+
 uint16_t CC1101Tranceiver::setFrequency(float freq)
 {
     // check allowed frequency range
     if (!(((freq > 300.0) && (freq < 348.0)) ||
           ((freq > 387.0) && (freq < 464.0)) ||
           ((freq > 779.0) && (freq < 928.0)))) {
-        fail("Invalid Baseband Frequency");
+        fail(F("Invalid Baseband Frequency"));
     }
 
     // set mode to standby
     SPIsendCommand(CC1101_CMD_IDLE);
 
     //set carrier frequency
-    uint32_t base = 1;
-    uint32_t FRF = (freq * (base << 16)) / 26.0;
+    uint32_t FRF = RadioProfile::frf(freq);
     int16_t state = SPIsetRegValue(CC1101_REG_FREQ2, (FRF & 0xFF0000) >> 16, 7, 0);
     state |= SPIsetRegValue(CC1101_REG_FREQ1, (FRF & 0x00FF00) >> 8, 7, 0);
     state |= SPIsetRegValue(CC1101_REG_FREQ0, FRF & 0x0000FF, 7, 0);
 
-    mFrequencyMhz = freq;
     return (setOutputPower(mPower));
 }
 
@@ -295,7 +526,7 @@ uint16_t CC1101Tranceiver::setReceiverBW(float rxBw)
         }
     }
 
-    fail("Invalid RxBW");
+    fail(F("Invalid RxBW"));
 }
 
 uint16_t CC1101Tranceiver::setDeviation(float freqDev)
@@ -323,17 +554,40 @@ uint16_t CC1101Tranceiver::setDeviation(float freqDev)
     return (state);
 }
 
+uint16_t CC1101Tranceiver::setChannelSpacing(float spacing)
+{
+    SPIsendCommand(CC1101_CMD_IDLE);
+
+    uint8_t e = 0;
+    uint8_t m = 0;
+    getExpMant(spacing * 1000.0, 256, 18, 3, e, m);
+
+    int16_t state = SPIsetRegValue(CC1101_REG_MDMCFG1, e, 1, 0);
+    state |= SPIsetRegValue(CC1101_REG_MDMCFG0, m);
+    return (state);
+}
+
+uint32_t CC1101Tranceiver::channelSpacing() const
+{
+    return RadioProfile::channelSpacingHz(mShadow[CC1101_REG_MDMCFG1] & 0x03, mShadow[CC1101_REG_MDMCFG0]);
+}
+
 uint16_t CC1101Tranceiver::setOutputPower(int8_t power)
 {
     // round to the known frequency settings
+    static constexpr uint32_t Frf374 = RadioProfile::frf(374.0f);
+    static constexpr uint32_t Frf650 = RadioProfile::frf(650.5f);
+    static constexpr uint32_t Frf891 = RadioProfile::frf(891.5f);
+    uint32_t frf = ((uint32_t) mShadow[CC1101_REG_FREQ2] << 16) | ((uint16_t) mShadow[CC1101_REG_FREQ1] << 8) |
+                   mShadow[CC1101_REG_FREQ0];
     uint8_t f;
-    if (mFrequencyMhz < 374.0) {
+    if (frf < Frf374) {
         // 315 MHz
         f = 0;
-    } else if (mFrequencyMhz < 650.5) {
+    } else if (frf < Frf650) {
         // 434 MHz
         f = 1;
-    } else if (mFrequencyMhz < 891.5) {
+    } else if (frf < Frf891) {
         // 868 MHz
         f = 2;
     } else {
@@ -378,13 +632,13 @@ uint16_t CC1101Tranceiver::setOutputPower(int8_t power)
             powerRaw = paTable[7][f];
             break;
         default:
-            fail("Invalid Power");
+            fail(F("Invalid Power"));
     }
 
     // store the value
     mPower = power;
 
-    if (mModulation == Modulation::ASK_OOK) {
+    if ((mShadow[CC1101_REG_MDMCFG2] & 0b01110000) == CC1101_MOD_FORMAT_ASK_OOK) {
         // Amplitude modulation:
         // PA_TABLE[0] is the power to be used when transmitting a 0  (no power)
         // PA_TABLE[1] is the power to be used when transmitting a 1  (full power)
@@ -435,7 +689,6 @@ void CC1101Tranceiver::setModulation(CC1101Tranceiver::Modulation modulation)
             SPIsetRegValue(CC1101_REG_FREND0, 1, 2, 0);
             break;
     }
-    mModulation = modulation;
     setOutputPower(mPower);
 }
 
@@ -470,93 +723,502 @@ void CC1101Tranceiver::setMaximumPacketLength(uint8_t max)
     SPIsetRegValue(CC1101_REG_PKTLEN, max);
 }
 
-ReadStatus CC1101Tranceiver::read(uint8_t *buffer, int buffersize)
+bool CC1101Tranceiver::startTransmit(const uint8_t *packet, uint8_t len)
 {
-    ReadStatus status;
+    // the length byte takes one byte of the packet
+    if (mTransmitting || len == 0 || len > CC1101_MAX_PACKET_LENGTH - 1) {
+        return false;
+    }
+
+    standby();
+    SPIsendCommand(CC1101_CMD_FLUSH_TX);
+
+    // a packet being received is abandoned, its reserved buffer is simply never completed
+    mRxExpected = 0;
+    mRxBuffer = nullptr;
+
+    mTxData = packet;
+    mTxLen = len;
+    mTransmitting = true;
+    // GDO2 rises when the TX FIFO drops below the threshold
+    SPIsetRegValue(CC1101_REG_IOCFG2, CC1101_GDO2_INV | CC1101_GDOX_TX_FIFO_ABOVE_THR);
 
-    size_t readBytes = 0;
-    uint8_t bytesInFIFO = SPIgetRegValue(CC1101_REG_RXBYTES, 6, 0);
-    while (bytesInFIFO > 0) {
-        // read the minimum between "remaining length" and bytesInFifo
-        SPIreadRegisterBurst(CC1101_REG_FIFO, bytesInFIFO, &(buffer[readBytes]));
-        readBytes += bytesInFIFO;
+    SPIwriteRegister(CC1101_REG_FIFO, len);
+    uint8_t first = len < CC1101_FIFO_SIZE - 1 ? len : CC1101_FIFO_SIZE - 1;
+    SPIwriteRegisterBurst(CC1101_REG_FIFO, packet, first);
+    mTxLoaded = first;
 
-        // Get how many bytes are left in FIFO.
-        bytesInFIFO = SPIgetRegValue(CC1101_REG_RXBYTES, 6, 0);
+    SPIsendCommand(CC1101_CMD_TX);
+    return true;
+}
+
+void CC1101Tranceiver::refillTransmit()
+{
+    if (!mTransmitting || mTxLoaded == mTxLen) {
+        return;
     }
 
-    status.len = readBytes;
-    status.errc = readBytes > 0 ? ReadErrCode::Ok : ReadErrCode::NoData;
-    return status;
+    // The status byte of every FIFO write tells the free room before the write, saturated at 15,
+    // so TXBYTES is never read: a NOP strobe tells when the saturated count has to be refreshed.
+    uint8_t status = SPIsendCommand(CC1101_CMD_NOP);
+    uint8_t freeBytes = status & CC1101_STATUS_FIFO_BYTES_MASK;
+    while (freeBytes > 0 && mTxLoaded < mTxLen &&
+           (status & CC1101_STATUS_STATE_MASK) != CC1101_STATUS_STATE_TXFIFO_UNDERFLOW) {
+        uint8_t left = mTxLen - mTxLoaded;
+        uint8_t bytesToWrite = freeBytes < left ? freeBytes : left;
+        status = SPIwriteRegisterBurst(CC1101_REG_FIFO, &mTxData[mTxLoaded], bytesToWrite);
+        mTxLoaded += bytesToWrite;
+
+        uint8_t before = status & CC1101_STATUS_FIFO_BYTES_MASK;
+        freeBytes = before > bytesToWrite ? before - bytesToWrite : 0;
+        if (freeBytes == 0 && before == CC1101_STATUS_FIFO_BYTES_MASK) {
+            status = SPIsendCommand(CC1101_CMD_NOP);
+            freeBytes = status & CC1101_STATUS_FIFO_BYTES_MASK;
+        }
+    }
 }
 
-int CC1101Tranceiver::transmit(uint8_t *packet, int packetLength)
+TxStatus CC1101Tranceiver::endTransmit()
 {
-    if (packetLength == 0)
-        return 0;
+    uint8_t status = SPIsendCommand(CC1101_CMD_NOP);
+    bool underflow = mTxLoaded < mTxLen ||
+                     (status & CC1101_STATUS_STATE_MASK) == CC1101_STATUS_STATE_TXFIFO_UNDERFLOW;
+    if (underflow) {
+        standby();
+        SPIsendCommand(CC1101_CMD_FLUSH_TX);
+    }
+    mTxData = nullptr;
 
-    // check packet length -- in case of Variable Packet length, length must be accounted
-    if(packetLength > CC1101_MAX_PACKET_LENGTH-1) {
-        fail("Transmit packet too long");
+    // restores the FIFO threshold interrupt of the receiver
+    receive();
+    return underflow ? TxStatus::Underflow : TxStatus::Sent;
+}
+
+void CC1101Tranceiver::standby()
+{
+    SPIsendCommand(CC1101_CMD_IDLE);
+}
+
+void CC1101Tranceiver::applyProfile(const RadioProfile &profile)
+{
+    standby();
+
+    // the image goes through the shadow, which is then in sync with the chip
+    memcpy_P(mShadow, profile.regs, sizeof(mShadow));
+    mLineCode = static_cast<LineCode>(pgm_read_byte(&profile.coding));
+    applyAddressFilter();
+    SPIwriteRegisterBurst(CC1101_REG_IOCFG2, mShadow, sizeof(mShadow));
+    mRegistersDirty = false;
+
+    // PATABLE depends on the band and the modulation
+    setOutputPower(mPower);
+}
+
+bool CC1101Tranceiver::addressOffload() const
+{
+    return mAddressCheck && mLineCode == LineCode::None;
+}
+
+void CC1101Tranceiver::applyAddressFilter()
+{
+    if (addressOffload()) {
+        mShadow[CC1101_REG_PKTCTRL1] = (mShadow[CC1101_REG_PKTCTRL1] & ~0x03) | CC1101_ADR_CHK_NO_BROADCAST;
+        mShadow[CC1101_REG_ADDR] = mAddress;
     }
+}
 
+void CC1101Tranceiver::setAddressFilter(bool enable, uint8_t address)
+{
+    mAddressCheck = enable;
+    mAddress = address;
     standby();
+    SPIsetRegValue(CC1101_REG_PKTCTRL1, addressOffload() ? CC1101_ADR_CHK_NO_BROADCAST : CC1101_ADR_CHK_NONE, 1, 0);
+    SPIsetRegValue(CC1101_REG_ADDR, address);
+    receive();
+}
 
-    SPIsendCommand(CC1101_CMD_FLUSH_TX);
+void CC1101Tranceiver::calibrateProfile(const RadioProfile &profile, uint8_t fscal[3])
+{
+    // The calibration starts from the FSCAL3..1 of the image: FSCAL3[5:4] enables the charge pump
+    // calibration and FSCAL2[5] selects the VCO core, the results are written over the rest
+    uint8_t settings[3];
+    memcpy_P(settings, &profile.regs[CC1101_REG_FSCAL3], sizeof(settings));
+    switchProfile(profile, settings);
+    standby();
+    SPIsendCommand(CC1101_CMD_CAL);
+    waitCalibration();
+    SPIreadRegisterBurst(CC1101_REG_FSCAL3, 3, fscal);
+}
+
+void CC1101Tranceiver::switchProfile(const RadioProfile &profile, const uint8_t fscal[3])
+{
+    standby();
+    SPIsendCommand(CC1101_CMD_FLUSH_RX);
 
-    uint8_t dataSent = 0;
+    // IOCFG2..0 belong to the handlers, MCSM1/MCSM0 to continuous mode and fast hopping
+    memcpy_P(&mShadow[CC1101_REG_FIFOTHR], &profile.regs[CC1101_REG_FIFOTHR], CC1101_REG_MCSM1 - CC1101_REG_FIFOTHR);
+    memcpy_P(&mShadow[CC1101_REG_FOCCFG], &profile.regs[CC1101_REG_FOCCFG], sizeof(mShadow) - CC1101_REG_FOCCFG);
+    // the calibration is not shadowed, it just rides along in the burst
+    memcpy(&mShadow[CC1101_REG_FSCAL3], fscal, 3);
+    mLineCode = static_cast<LineCode>(pgm_read_byte(&profile.coding));
+    applyAddressFilter();
+    SPIwriteRegisterBurst(CC1101_REG_FIFOTHR, &mShadow[CC1101_REG_FIFOTHR], sizeof(mShadow) - CC1101_REG_FIFOTHR);
 
-    SPIwriteRegister(CC1101_REG_FIFO, packetLength);
-    dataSent += 1;
+    setOutputPower(mPower);
 
-    // We don't handle addresses, in case we should handle this.
-/*
-    uint8_t filter = SPIgetRegValue(CC1101_REG_PKTCTRL1, 1, 0);
-    if(filter != CC1101_ADR_CHK_NONE) {
-        SPIwriteRegister(CC1101_REG_FIFO, addr);
-        dataSent += 1;
+    mRxExpected = 0;
+    mRxBuffer = nullptr;
+    SPIsendCommand(CC1101_CMD_RX);
+    waitReceiving();
+}
+
+void CC1101Tranceiver::receive()
+{
+    standby();
+    SPIsendCommand(CC1101_CMD_FLUSH_RX);
+    if (mTransmitting) {
+        SPIsetRegValue(CC1101_REG_IOCFG2, CC1101_GDOX_RX_FIFO_FULL);
+        mTransmitting = false;
     }
-*/
+    // a packet interrupted by the flush is lost; its reserved buffer is simply never completed
+    mRxExpected = 0;
+    mRxBuffer = nullptr;
+    SPIsendCommand(CC1101_CMD_RX);
+}
 
-    // fill the FIFO.
-    uint8_t initialWrite = min((uint8_t)packetLength, (uint8_t)(CC1101_FIFO_SIZE - dataSent));
-    SPIwriteRegisterBurst(CC1101_REG_FIFO, packet, initialWrite);
-    dataSent += initialWrite;
+void CC1101Tranceiver::setContinuousReceive(bool enable)
+{
+    // the calibration stays on IDLE to RX/TX: receive() and the turnarounds after transmitting
+    // still calibrate, packets received back to back never do
+    standby();
+    SPIsetRegValue(CC1101_REG_MCSM1, enable ? CC1101_RXOFF_RX : CC1101_RXOFF_IDLE, 3, 2);
+    mContinuous = enable;
+}
 
-    SPIsendCommand(CC1101_CMD_TX);
+bool CC1101Tranceiver::recalibrate()
+{
+    if (!mContinuous || SPIgetRegValue(CC1101_REG_MCSM0, 5, 4) != CC1101_FS_AUTOCAL_IDLE_TO_RXTX || packetPending()) {
+        return false;
+    }
 
-    while (dataSent < packetLength) {
-        uint8_t bytesInFIFO = SPIgetRegValue(CC1101_REG_TXBYTES, 6, 0);
+    receive();
+    return true;
+}
 
-        if (bytesInFIFO < CC1101_FIFO_SIZE) {
-            uint8_t bytesToWrite = min((uint8_t)(CC1101_FIFO_SIZE - bytesInFIFO), (uint8_t)(packetLength - dataSent));
-            SPIwriteRegisterBurst(CC1101_REG_FIFO, &packet[dataSent], bytesToWrite);
-            dataSent += bytesToWrite;
-        } else {
-            // wait for radio to send some data.
-            /*
-              * Does this work for all rates? If 1 ms is longer than the 1ms delay
-              * then the entire FIFO will be transmitted during that delay.
-              *
-              * TODO: test this on real hardware
-            */
-            delayMicroseconds(250);
+void CC1101Tranceiver::waitCalibration()
+{
+    for (int i = 0; i < 100; ++i) {
+        if (SPIgetRegValue(CC1101_REG_MARCSTATE, 4, 0) == CC1101_MARC_STATE_IDLE) {
+            break;
         }
+        delayMicroseconds(10);
     }
+}
 
-    return dataSent;
+void CC1101Tranceiver::setFastHopping(bool enable)
+{
+    standby();
+    if (enable) {
+        SPIsetRegValue(CC1101_REG_MCSM0, CC1101_FS_AUTOCAL_NEVER, 5, 4);
+    } else {
+        SPIsetRegValue(CC1101_REG_MCSM0, CC1101_FS_AUTOCAL_IDLE_TO_RXTX, 5, 4);
+    }
 }
 
-void CC1101Tranceiver::standby()
+bool CC1101Tranceiver::packetPending()
 {
-    SPIsendCommand(CC1101_CMD_IDLE);
+    // a packet is arriving, is being parsed, or is waiting in the FIFO for its interrupt; or one is
+    // being transmitted
+    return mTransmitting || syncDetected() || mRxExpected != 0 || SPIgetRegValue(CC1101_REG_RXBYTES, 6, 0) != 0;
 }
 
-void CC1101Tranceiver::receive()
+void CC1101Tranceiver::currentChannel(HopChannel &channel) const
+{
+    channel.frf = ((uint32_t) mShadow[CC1101_REG_FREQ2] << 16) | ((uint16_t) mShadow[CC1101_REG_FREQ1] << 8) |
+                  mShadow[CC1101_REG_FREQ0];
+    channel.channr = mShadow[CC1101_REG_CHANNR];
+}
+
+void CC1101Tranceiver::calibrateChannel(HopChannel &channel)
+{
+    standby();
+    SPIsetRegValue(CC1101_REG_FREQ2, channel.frf >> 16);
+    SPIsetRegValue(CC1101_REG_FREQ1, channel.frf >> 8);
+    SPIsetRegValue(CC1101_REG_FREQ0, channel.frf);
+    SPIsetRegValue(CC1101_REG_CHANNR, channel.channr);
+
+    SPIsendCommand(CC1101_CMD_CAL);
+    waitCalibration();
+    SPIreadRegisterBurst(CC1101_REG_FSCAL3, sizeof(channel.fscal), channel.fscal);
+}
+
+void CC1101Tranceiver::hopTo(const HopChannel &channel)
 {
     standby();
     SPIsendCommand(CC1101_CMD_FLUSH_RX);
+
+    SPIsetRegValue(CC1101_REG_FREQ2, channel.frf >> 16);
+    SPIsetRegValue(CC1101_REG_FREQ1, channel.frf >> 8);
+    SPIsetRegValue(CC1101_REG_FREQ0, channel.frf);
+    SPIsetRegValue(CC1101_REG_CHANNR, channel.channr);
+    SPIwriteRegisterBurst(CC1101_REG_FSCAL3, channel.fscal, sizeof(channel.fscal));
+
+    mRxExpected = 0;
+    mRxBuffer = nullptr;
     SPIsendCommand(CC1101_CMD_RX);
+    waitReceiving();
+}
+
+void CC1101Tranceiver::waitReceiving()
+{
+    // the synthesizer only has to settle, wait for it so that the switch time can be measured
+    for (int i = 0; i < 100; ++i) {
+        if ((SPIsendCommand(CC1101_CMD_NOP) & CC1101_STATUS_STATE_MASK) == CC1101_STATUS_STATE_RX) {
+            break;
+        }
+    }
+}
+
+uint16_t CC1101Tranceiver::beginSweep(float freq, float spacing, uint8_t numSteps)
+{
+    standby();
+    SPIsendCommand(CC1101_CMD_FLUSH_RX);
+    mRxExpected = 0;
+    mRxBuffer = nullptr;
+
+    mParkedGdo[0] = mShadow[CC1101_REG_IOCFG2];
+    mParkedGdo[1] = mShadow[CC1101_REG_IOCFG0];
+    SPIsetRegValue(CC1101_REG_IOCFG2, CC1101_GDOX_HW_TO_0);
+    SPIsetRegValue(CC1101_REG_IOCFG0, CC1101_GDOX_HW_TO_0);
+
+    setFastHopping(true);
+    uint16_t state = setFrequency(freq);
+    state |= setChannelSpacing(spacing);
+    SPIsetRegValue(CC1101_REG_CHANNR, numSteps / 2);
+    SPIsendCommand(CC1101_CMD_CAL);
+    waitCalibration();
+
+    // The RSSI needs a few channel filter time constants to settle after entering RX,
+    // 16 / RX BW = 16 * 8 * (4 + M) * 2^E / f_xosc: 20 us at 812 kHz, 275 us at 58 kHz
+    uint8_t bw = mShadow[CC1101_REG_MDMCFG4] >> 4;
+    mRssiDelayUs = ((uint16_t) 128 * (4 + (bw & 0x03)) << (bw >> 2)) / 26;
+
+    return state;
+}
+
+void CC1101Tranceiver::sweep(uint8_t *rssi, uint8_t numSteps)
+{
+    // packets caught on the way must not overflow the FIFO, which would block RX
+    SPIsendCommand(CC1101_CMD_FLUSH_RX);
+    for (uint8_t i = 0; i < numSteps; ++i) {
+        // CHANNR goes out with the RX strobe
+        SPIsendCommand(CC1101_CMD_IDLE);
+        SPIsetRegValue(CC1101_REG_CHANNR, i);
+        SPIsendCommand(CC1101_CMD_RX);
+        waitReceiving();
+        delayMicroseconds(mRssiDelayUs);
+        rssi[i] = SPIreadRegister(CC1101_REG_RSSI);
+    }
+}
+
+void CC1101Tranceiver::endSweep(const RadioProfile &profile)
+{
+    uint8_t fscal[3];
+    calibrateProfile(profile, fscal);
+    SPIsetRegValue(CC1101_REG_IOCFG2, mParkedGdo[0]);
+    SPIsetRegValue(CC1101_REG_IOCFG0, mParkedGdo[1]);
+    setFastHopping(false);
+    receive();
+}
+
+void CC1101Tranceiver::setReceiveHandlers(uint8_t *(*allocator)(uint16_t len), void (*complete)(const ReadStatus &status))
+{
+    mRxAllocator = allocator;
+    mRxComplete = complete;
+}
+
+void CC1101Tranceiver::completePacket(ReadErrCode errc)
+{
+    ReadStatus status;
+    status.errc = errc;
+    status.len = mRxLen;
+
+    mRxExpected = 0;
+    mRxLen = 0;
+    mRxBuffer = nullptr;
+    ++mRxCompleted;
+
+    if (mRxComplete != nullptr) {
+        mRxComplete(status);
+    }
+}
+
+bool CC1101Tranceiver::parseFifo(bool packetEnd)
+{
+    // While a packet is still being received never empty the FIFO completely (see CC1101 errata).
+    // In continuous mode the next packet may already be arriving after the end of the previous one.
+    bool receiving = !packetEnd || syncDetected();
+
+    // Bytes known to be in the FIFO. RXBYTES is only read when the exact count is needed; otherwise
+    // the threshold, the packet length and the status byte of each burst tell how much to read.
+    uint8_t available;
+    if (!packetEnd) {
+        // GDO2 is asserted: the FIFO holds at least the threshold
+        available = rxFifoThreshold();
+    } else if (receiving) {
+        available = readRxBytes();
+        if (available == RxBytesOverflow) {
+            rxOverflow();
+            return false;
+        }
+    } else {
+        // the packet ended and nothing else is arriving: the rest of it is in the FIFO,
+        // or at least the length byte of a packet not seen yet
+        available = mRxExpected != 0 ? fifoRemainder() : 1;
+    }
+
+    if (receiving) {
+        if (available <= 1) {
+            return true;
+        }
+        --available;
+    }
+
+    // The FIFO holds a sequence of length byte, payload, RSSI and LQI status bytes
+    while (available > 0) {
+        if (mRxExpected == 0) {
+            // start of a packet: the length byte tells how much room it needs
+            uint8_t length;
+            uint8_t status = SPIreadRegisterBurst(CC1101_REG_FIFO, 1, &length);
+            if ((status & CC1101_STATUS_STATE_MASK) == CC1101_STATUS_STATE_RXFIFO_OVERFLOW) {
+                rxOverflow();
+                return false;
+            }
+            if ((status & CC1101_STATUS_FIFO_BYTES_MASK) == 0) {
+                // end of packet without data, the byte read is garbage
+                break;
+            }
+            --available;
+
+            mRxExpected = length + 3;
+            mRxBuffer = mRxAllocator != nullptr ? mRxAllocator(mRxExpected) : nullptr;
+            if (mRxBuffer != nullptr) {
+                mRxBuffer[0] = length;
+            }
+            mRxLen = 1;
+            if (!receiving) {
+                // the whole packet is in
+                available = fifoRemainder();
+            }
+            continue;
+        }
+
+        uint8_t numBytes = available;
+        if (numBytes > mRxExpected - mRxLen) {
+            numBytes = mRxExpected - mRxLen;
+        }
+
+        uint8_t status;
+        uint8_t lastBurst = numBytes;
+        if (mRxBuffer != nullptr) {
+            status = SPIreadRegisterBurst(CC1101_REG_FIFO, numBytes, &(mRxBuffer[mRxLen]));
+        } else {
+            // no room for this packet, but the bytes of the following ones are behind it
+            uint8_t discard[8];
+            for (uint8_t left = numBytes; left > 0; left -= lastBurst) {
+                lastBurst = left < sizeof(discard) ? left : sizeof(discard);
+                status = SPIreadRegisterBurst(CC1101_REG_FIFO, lastBurst, discard);
+            }
+        }
+        if ((status & CC1101_STATUS_STATE_MASK) == CC1101_STATUS_STATE_RXFIFO_OVERFLOW) {
+            rxOverflow();
+            return false;
+        }
+        mRxLen += numBytes;
+        available -= numBytes;
+
+        if (mRxLen == mRxExpected) {
+            completePacket(mRxBuffer != nullptr ? ReadErrCode::Ok : ReadErrCode::Dropped);
+
+            if (!receiving && available == 0) {
+                // Other packets behind this one? The status byte counts the bytes in the FIFO
+                // before the last burst, unless it saturated.
+                uint8_t before = status & CC1101_STATUS_FIFO_BYTES_MASK;
+                if (before < CC1101_STATUS_FIFO_BYTES_MASK) {
+                    available = before - lastBurst;
+                } else {
+                    available = readRxBytes();
+                    if (available == RxBytesOverflow) {
+                        rxOverflow();
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+void CC1101Tranceiver::drainFifo()
+{
+    // The threshold interrupt may be served after endReceive() already emptied the FIFO. At high
+    // bitrates the FIFO can refill above the threshold during the burst: GDO2 then stays asserted
+    // and there is no new edge, so keep draining until it drops.
+    while (digitalRead(_gdo2) == HIGH) {
+        if (!parseFifo(false)) {
+            break;
+        }
+    }
+}
+
+uint8_t CC1101Tranceiver::rxFifoThreshold() const
+{
+    // FIFOTHR[3:0] sets the RX threshold to 4 * (value + 1) bytes
+    return 4 * ((mShadow[CC1101_REG_FIFOTHR] & 0x0f) + 1);
+}
+
+uint8_t CC1101Tranceiver::fifoRemainder() const
+{
+    // more than a FIFO left means the chip has overflowed, the status byte will tell
+    uint16_t left = mRxExpected - mRxLen;
+    return left < CC1101_FIFO_SIZE ? left : CC1101_FIFO_SIZE;
+}
+
+uint8_t CC1101Tranceiver::readRxBytes()
+{
+    uint8_t rxBytes = SPIgetRegValue(CC1101_REG_RXBYTES);
+    return (rxBytes & 0x80) ? RxBytesOverflow : rxBytes;
+}
+
+void CC1101Tranceiver::rxOverflow()
+{
+    completePacket(ReadErrCode::Overflow);
+    receive();
+}
+
+void CC1101Tranceiver::endReceive()
+{
+    uint8_t completed = mRxCompleted;
+    if (!parseFifo(true)) {
+        return;
+    }
+
+    // In continuous mode a packet still being parsed is fine if the next one is already arriving:
+    // the edge may be late, and the packet being parsed the next one. It carries over to the
+    // following interrupts.
+    bool truncated = mRxExpected != 0 && !(mContinuous && syncDetected());
+    if (truncated) {
+        // the chip gave up on the packet, e.g. it left RX
+        completePacket(ReadErrCode::NoData);
+    } else if (completed == mRxCompleted && mRxExpected == 0) {
+        // End of packet without data. The chip takes a packet failing the address check back out
+        // of the FIFO, which is then empty: a discard, not a timeout.
+        completePacket(addressOffload() && readRxBytes() == 0 ? ReadErrCode::Discarded : ReadErrCode::NoData);
+    }
+
+    if (!mContinuous || truncated) {
+        receive();
+    }
 }
 
 void CC1101Tranceiver::setReceiveHandler(void (*func)(void), CC1101Tranceiver::SignalDirection direction)
@@ -567,10 +1229,16 @@ void CC1101Tranceiver::setReceiveHandler(void (*func)(void), CC1101Tranceiver::S
     attachInterrupt(digitalPinToInterrupt(_gdo0), func, static_cast<int >(direction));
 }
 
-void CC1101Tranceiver::setTransmitHandler(void (*func)(void), CC1101Tranceiver::SignalDirection direction)
+bool CC1101Tranceiver::syncDetected() const
+{
+    return digitalRead(_gdo0) == HIGH;
+}
+
+void CC1101Tranceiver::setFifoHandler(void (*func)(void), CC1101Tranceiver::SignalDirection direction)
 {
     standby();
     SPIsendCommand(CC1101_CMD_FLUSH_TX);
-    SPIsetRegValue(CC1101_REG_IOCFG2, CC1101_GDOX_TX_FIFO_UNDERFLOW);
+    SPIsetRegValue(CC1101_REG_IOCFG2, CC1101_GDOX_RX_FIFO_FULL);
+    mTransmitting = false;
     attachInterrupt(digitalPinToInterrupt(_gdo2), func, static_cast<int >(direction));
 }
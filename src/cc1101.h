@@ -8,16 +8,45 @@
 
 #include <SPI.h>
 #include "cc1101consts.h"
+#include "LineCode.h"
+
+// On the Nano the FIFO is drained from the interrupts through the SPI registers directly, with
+// port writes for the chip select. On the ESP32 each transaction goes out as a block through the
+// SPI peripheral buffer. Define CC1101_PORTABLE_SPI to use the Arduino SPI library byte by byte.
+#if defined(BOARD_NANO) && !defined(CC1101_PORTABLE_SPI)
+#define CC1101_AVR_SPI
+#elif defined(BOARD_HUZZAH32) && !defined(CC1101_PORTABLE_SPI)
+#define CC1101_ESP32_SPI
+#endif
 
 enum class ReadErrCode : uint8_t {
     Ok = 0x00,
     CrcError = 0x01,
+    Overflow = 0x02,
+    Dropped = 0x03,
+    // end of packet with an empty FIFO while the chip checks addresses: the packet was dropped
+    Discarded = 0x04,
     NoData = 0xff
 };
 
+enum class TxStatus : uint8_t {
+    Sent = 0x00,
+    Underflow = 0x01
+};
+
+struct RadioProfile;
+
+// A channel for fast hopping: frequency, channel number and the synthesizer calibration
+// (FSCAL3, FSCAL2, FSCAL1) measured once by CC1101Tranceiver::calibrateChannel().
+struct HopChannel {
+    uint32_t frf = 0;       // FREQ2:FREQ1:FREQ0
+    uint8_t channr = 0;
+    uint8_t fscal[3] = {};
+};
+
 struct ReadStatus {
     ReadErrCode errc = ReadErrCode::Ok;
-    uint8_t len = 0;
+    uint16_t len = 0;
 };
 
 class CC1101Tranceiver {
@@ -25,6 +54,8 @@ public:
     CC1101Tranceiver(uint8_t cs, uint8_t gdo0, uint8_t gdo2, uint8_t rst = 0xff);
 
     int initialize();
+    // Resets the chip and writes the profile in one burst, the profile must be in program memory
+    int initialize(const RadioProfile &profile);
 
     enum class SyncType {
         NoSync = 0, Sync15_16, Sync16_16, Sync30_32,
@@ -37,7 +68,7 @@ public:
         FSK2, GFSK, ASK_OOK, FSK4, MFSK
     };
     enum class SignalDirection {
-        Change = 1, Falling = 1, Rising = 2
+        Change = CHANGE, Falling = FALLING, Rising = RISING
     };
 
 private:
@@ -46,17 +77,68 @@ private:
     uint8_t _gdo2 = 0xff;
     uint8_t _rst = 0xff;
 
-    float mFrequencyMhz = 868.3f;
     float mBitrate;
     float mPower;
-    Modulation mModulation = Modulation::GFSK;
     bool mVariableLength;
     uint8_t mFixedPacketLength;
 
     SPISettings _spiSettings;
     SPIClass &_spi;
+#ifdef CC1101_AVR_SPI
+    volatile uint8_t *mCsPort;
+    uint8_t mCsMask;
+#endif
+
+    // streaming receive state, shared between the GDO0 and GDO2 interrupts
+    uint8_t *(*mRxAllocator)(uint16_t len) = nullptr;
+    void (*mRxComplete)(const ReadStatus &status) = nullptr;
+    uint8_t *mRxBuffer = nullptr;
+    volatile uint16_t mRxExpected = 0;      // bytes of the packet being parsed, 0 waiting for a length byte
+    volatile uint16_t mRxLen = 0;
+    uint8_t mRxCompleted = 0;
+    volatile bool mTransmitting = false;
+    // packet being transmitted, loaded into the TX FIFO as it drains
+    const uint8_t *mTxData = nullptr;
+    uint8_t mTxLen = 0;
+    volatile uint8_t mTxLoaded = 0;
+    bool mContinuous = false;
+    volatile uint32_t mSpiTransactions = 0;
+
+    // line code of the profile applied last
+    volatile LineCode mLineCode = LineCode::None;
+
+    // address filter, kept across profile changes
+    bool mAddressCheck = false;
+    uint8_t mAddress = 0;
+
+    // sweep state: IOCFG2 and IOCFG0 while parked, RSSI settling time
+    uint8_t mParkedGdo[2] = {};
+    uint16_t mRssiDelayUs = 0;
 
+    // Shadow of the configuration registers 0x00 - 0x2E: masked updates only touch the shadow,
+    // the dirty registers are written in bursts before the next command strobe.
+    uint8_t mShadow[CC1101_REG_TEST0 + 1] = {};
+    uint8_t mDirty[(CC1101_REG_TEST0 + 8) / 8] = {};
+    bool mRegistersDirty = false;
+#ifdef CC1101_VERIFY_REGISTERS
+    uint16_t mRegisterMismatches = 0;
+#endif
+
+    bool waitChipReady();
+    void waitCalibration();
+    void waitReceiving();
     bool findChip();
+    bool isShadowed(uint8_t reg) const;
+    bool isDirty(uint8_t reg) const;
+    bool addressOffload() const;
+    void applyAddressFilter();
+    uint8_t SPIstrobe(uint8_t cmd);
+    bool parseFifo(bool packetEnd);
+    uint8_t fifoRemainder() const;
+    uint8_t rxFifoThreshold() const;
+    uint8_t readRxBytes();
+    void rxOverflow();
+    void completePacket(ReadErrCode errc);
 
 public:
     uint16_t getChipVersion();
@@ -66,6 +148,10 @@ public:
     uint16_t setReceiverBW(float rxBw);
     uint16_t setDeviation(float freqDev);
     uint16_t setOutputPower(int8_t power);
+    // in kHz, 25.4 to 405.5 for a 26 MHz crystal
+    uint16_t setChannelSpacing(float spacing);
+    // in Hz
+    uint32_t channelSpacing() const;
 
     void setModulation(Modulation modulation);
     void setMaximumPacketLength(uint8_t max = 255);
@@ -78,23 +164,102 @@ public:
 
     void standby();
 
+    // Writes the whole register image in one burst, the profile must be in program memory.
+    // Apply it before setting the handlers and continuous mode, which own IOCFGx and MCSMx.
+    void applyProfile(const RadioProfile &profile);
+    // Time slicing between profiles: like applyProfile(), but keeps IOCFGx and MCSM1/MCSM0 as they
+    // are, and restores the calibration saved by calibrateProfile() instead of recalibrating.
+    // Use with fast hopping enabled; the radio is left receiving.
+    void calibrateProfile(const RadioProfile &profile, uint8_t fscal[3]);
+    void switchProfile(const RadioProfile &profile, const uint8_t fscal[3]);
+    // Line code of the current profile, left to the packet handler to decode
+    LineCode lineCode() const { return mLineCode; }
+
+    // The chip drops packets whose first payload byte is not address, before they reach the FIFO
+    // (PKTCTRL1 ADR_CHK, no broadcast). Kept across profile changes, but only active on profiles
+    // without a line code: the first byte over the air is then not the first payload byte.
+    void setAddressFilter(bool enable, uint8_t address = 0);
+
+    // GDO0 is shared: sync word received and end of packet while receiving, sync word sent and end
+    // of packet or TX FIFO underflow while transmitting.
     void setReceiveHandler(void (*func)(void), SignalDirection direction = SignalDirection::Rising);
-    void setTransmitHandler(void (*func)(void), SignalDirection direction = SignalDirection::Rising);
+    // GDO2 is shared: RX FIFO above threshold while receiving, TX FIFO below threshold while transmitting.
+    void setFifoHandler(void (*func)(void), SignalDirection direction = SignalDirection::Rising);
+    bool isTransmitting() const { return mTransmitting; }
+
+    // True while GDO0 is asserted, i.e. between sync word detection and the end of the packet.
+    bool syncDetected() const;
 
-    ReadStatus read(uint8_t *buffer, int buffersize);
     void receive();
 
-    int transmit(uint8_t *buffer, int buffersize);
+    // Streaming receive: drainFifo() on every FIFO threshold interrupt, endReceive() at the end of
+    // the packet. Allows packets longer than the 64 bytes FIFO, and several packets in the FIFO.
+    // The buffer of each packet is requested to the allocator once its length byte is known, so
+    // that it can be sized exactly; the packet is dropped if the allocator returns nullptr.
+    // complete is called for every packet, once its last byte has been read.
+    void setReceiveHandlers(uint8_t *(*allocator)(uint16_t len), void (*complete)(const ReadStatus &status));
+    void drainFifo();
+    void endReceive();
+
+    // Continuous receive: the chip goes back to RX by itself after each packet (MCSM1 RXOFF), so
+    // there is no blind time between back to back packets. It then never goes through IDLE, where
+    // the synthesizer is calibrated on the way to RX: call recalibrate() now and then.
+    void setContinuousReceive(bool enable);
+    // Takes the radio through IDLE back to RX, which recalibrates the synthesizer; the radio is off
+    // the air for about 0.8 ms. Does nothing and returns false if a packet is pending, or if there
+    // is no need: continuous receive off, or auto calibration off (fast hopping, sweeps).
+    // Call with the interrupts off.
+    bool recalibrate();
+
+    // Fast hopping: with auto calibration off, a hop restores the cached calibration of the
+    // channel instead of recalibrating the synthesizer.
+    void setFastHopping(bool enable);
+    void calibrateChannel(HopChannel &channel);
+    void hopTo(const HopChannel &channel);
+    // frequency and channel the radio is tuned to
+    void currentChannel(HopChannel &channel) const;
+    // true if switching channel now would lose a packet
+    bool packetPending();
+
+    // RSSI sweep: sweep() samples the RSSI of channels 0 to numSteps - 1, spaced spacing kHz from
+    // freq MHz, as fast as the synthesizer and the RSSI settle. The synthesizer is calibrated once
+    // on the middle channel, which holds for spans of a few MHz. GDO0 and GDO2 are held low while
+    // sweeping, so that the receive interrupts stay quiet; endSweep() puts them back, switches to
+    // profile and resumes receiving.
+    uint16_t beginSweep(float freq, float spacing, uint8_t numSteps);
+    void sweep(uint8_t *rssi, uint8_t numSteps);
+    void endSweep(const RadioProfile &profile);
+
+    // Asynchronous transmit: startTransmit() loads the first FIFO of the packet and returns, the
+    // FIFO handler calls refillTransmit() as the FIFO drains and the receive handler calls
+    // endTransmit() once GDO0 falls, which puts the radio back to receive. The packet must stay in
+    // place until then. Returns false if the radio is already transmitting or the length is bad.
+    bool startTransmit(const uint8_t *packet, uint8_t len);
+    void refillTransmit();
+    TxStatus endTransmit();
 
     uint16_t SPIgetRegValue(uint8_t reg, uint8_t msb = 7, uint8_t lsb = 0);
-    uint16_t SPIsetRegValue(uint8_t reg, uint8_t value, uint8_t msb = 7, uint8_t lsb = 0, uint8_t checkInterval = 2);
-    void SPIreadRegisterBurst(uint8_t reg, uint8_t numBytes, uint8_t *inBytes);
+    uint16_t SPIsetRegValue(uint8_t reg, uint8_t value, uint8_t msb = 7, uint8_t lsb = 0);
+    // Burst accesses, command strobes and SPItransfer return the chip status byte sampled on the
+    // header byte: state and RX bytes available for reads, TX bytes free for writes.
+    uint8_t SPIreadRegisterBurst(uint8_t reg, uint8_t numBytes, uint8_t *inBytes);
     uint8_t SPIreadRegister(uint8_t reg);
-    void SPIwriteRegisterBurst(uint8_t reg, uint8_t *data, size_t len);
+    uint8_t SPIwriteRegisterBurst(uint8_t reg, const uint8_t *data, size_t len);
     void SPIwriteRegister(uint8_t reg, uint8_t data);
-    void SPIsendCommand(uint8_t cmd);
+    uint8_t SPIsendCommand(uint8_t cmd);
+
+    // number of SPI transactions (chip select cycles) since power up
+    uint32_t spiTransactions() const { return mSpiTransactions; }
+
+    // Configuration changes reach the chip with the next command strobe, or here.
+    // Build with CC1101_VERIFY_REGISTERS to read every flush back and compare shadowed reads
+    // with the chip, counting the differences.
+    void flushRegisters();
+#ifdef CC1101_VERIFY_REGISTERS
+    uint16_t registerMismatches() const { return mRegisterMismatches; }
+#endif
 
-    void SPItransfer(uint8_t cmd, uint8_t reg, uint8_t *dataOut, uint8_t *dataIn, uint8_t numBytes);
+    uint8_t SPItransfer(uint8_t cmd, uint8_t reg, const uint8_t *dataOut, uint8_t *dataIn, uint8_t numBytes);
 };
 
 #endif //CCSNIFFER_CC1101_H
@@ -17,6 +17,19 @@
 #define CC1101_DIV_EXPONENT                           16
 #define CC1101_FIFO_SIZE                              64
 
+// CC1101 chip status byte, returned on the header byte of every SPI transaction
+#define CC1101_STATUS_CHIP_RDYN                       0b10000000  //  7     7     chip ready (active low)
+#define CC1101_STATUS_STATE_MASK                      0b01110000  //  6     4     main state machine mode
+#define CC1101_STATUS_STATE_IDLE                      0b00000000
+#define CC1101_STATUS_STATE_RX                        0b00010000
+#define CC1101_STATUS_STATE_TX                        0b00100000
+#define CC1101_STATUS_STATE_FSTXON                    0b00110000
+#define CC1101_STATUS_STATE_CALIBRATE                 0b01000000
+#define CC1101_STATUS_STATE_SETTLING                  0b01010000
+#define CC1101_STATUS_STATE_RXFIFO_OVERFLOW           0b01100000
+#define CC1101_STATUS_STATE_TXFIFO_UNDERFLOW          0b01110000
+#define CC1101_STATUS_FIFO_BYTES_MASK                 0b00001111  //  3     0     RX bytes available (reads) or TX bytes free (writes), saturates at 15
+
 // CC1101 SPI commands
 #define CC1101_CMD_READ                               0b10000000
 #define CC1101_CMD_WRITE                              0b00000000
@@ -174,6 +187,7 @@
 #define CC1101_RX_ATTEN_12_DB                         0b00100000  //  5     4                     12 dB
 #define CC1101_RX_ATTEN_18_DB                         0b00110000  //  5     4                     18 dB
 #define CC1101_FIFO_THR_TX_61_RX_4                    0b00000000  //  3     0     TX fifo threshold: 61, RX fifo threshold: 4
+#define CC1101_FIFO_THR_TX_33_RX_32                   0b00000111  //  3     0     TX fifo threshold: 33, RX fifo threshold: 32
 
 // CC1101_REG_SYNC1
 #define CC1101_SYNC_WORD_MSB                          0xD3        //  7     0     sync word MSB
@@ -1,36 +1,158 @@
 #include <Arduino.h>
 #include "cc1101.h"
+#include "ChannelScanner.h"
+#include "DedupTable.h"
+#include "Frame.h"
+#include "LineCode.h"
+#include "PacketFilter.h"
+#include "PacketOutput.h"
 #include "PacketQueue.h"
+#include "PriorityPolicy.h"
+#include "ProfileScheduler.h"
+#include "ProtocolLayout.h"
+#include "RadioProfile.h"
 #include "SerialHandler.h"
+#include "SpscRing.h"
+#include "Stats.h"
+#include "Timestamp.h"
 
+// Queues are variable length rings of blocks of QUEUE_GRANULE_SIZE bytes each, RAW_QUEUE_GRANULES
+// blocks for the raw packets and QUEUE_GRANULES for the processed ones.
+// A packet takes 4 bytes of ring header, its packet header and its data, rounded up to whole blocks:
+// raw packets have an 11 byte header (12 on the ESP32) and the FIFO bytes, length, payload, RSSI
+// and LQI; processed packets have a 15 byte header (16 on the ESP32) and the payload or fields.
+// Output is formatted OUTPUT_LINE_SIZE bytes at a time into the serial TX buffer, see SerialHandler.
+// Packets to transmit wait in a queue of TX_QUEUE_LENGTH packets of up to TX_MAX_PACKET bytes.
+// A sweep record takes up to 8 + SWEEP_MAX_STEPS bytes and is only sent if it fits the TX buffer whole.
 #if defined (BOARD_HUZZAH32)
 CC1101Tranceiver radio(25, 39, 34);
+#define RAW_QUEUE_GRANULES 128
+#define QUEUE_GRANULES 128
+#define QUEUE_GRANULE_SIZE 16
+#define OUTPUT_LINE_SIZE 128
+#define TX_QUEUE_LENGTH 8
+// the length byte takes one byte of the longest packet
+#define TX_MAX_PACKET (CC1101_MAX_PACKET_LENGTH - 1)
+#define SWEEP_MAX_STEPS 64
 #elif defined (BOARD_NANO)
 CC1101Tranceiver radio(10, 3, 2);
+// 256 bytes of raw ring: payloads longer than 238 bytes don't fit and count as queue full.
+// 128 bytes of processed ring, the RAM goes to the 256 byte HardwareSerial TX buffer (platformio.ini)
+// where the packets leaving it wait as text.
+#define RAW_QUEUE_GRANULES 64
+#define QUEUE_GRANULES 32
+#define QUEUE_GRANULE_SIZE 4
+#define OUTPUT_LINE_SIZE 32
+#define TX_QUEUE_LENGTH 2
+// as long as a command line carries in hex
+#define TX_MAX_PACKET ((MAXSERIAL - 1) / 2)
+// binary records, with CRC and COBS, four at a time in the HardwareSerial TX buffer
+#define SWEEP_MAX_STEPS 48
+// The 2048 bytes of SRAM also hold the Arduino core, the small globals, the stack and the interrupt
+// frames: the large objects of this file must stay within this budget, see the check at the end.
+#define STATIC_RAM_BUDGET 1600
 #endif
 
-using UnprocessedQueue = RawPacketsQueue<4,64>;
+using UnprocessedQueue = RawPacketsQueue<RAW_QUEUE_GRANULES,QUEUE_GRANULE_SIZE>;
 UnprocessedQueue unprocessedQueue;
-using Queue = PacketsQueue<4,64>;
+using Queue = PacketsQueue<QUEUE_GRANULES,QUEUE_GRANULE_SIZE>;
 Queue queue;
 
 SerialHandler serial;
+ChannelScanner scanner(radio);
+ProfileScheduler scheduler(radio);
+PacketFilter filter;
+DedupTable dedup;
+PriorityPolicy policy;
 
+uint8_t *allocRaw(uint16_t len);
+void rxComplete(const ReadStatus &status);
 void irqRead(void);
-void irqSent(void);
+void irqFifo(void);
+void irqSent(TxStatus status);
+
+PipelineStats stats;
+LatencyHistogram latency;
+MicrosClock microsClock;
 
 volatile int numSent = 0;
-volatile int numTimeout = 0;
-volatile int numRecvIrq = 0;
+volatile uint16_t rxSequence = 0;
+// the stamps of the sync words whose packets are still in the FIFO
+SyncStamps<4> syncStamps;
+
+// Packets to transmit: loop() queues them and starts them one at a time, the interrupts load
+// the FIFO and report the end through irqSent()
+struct TxPacket {
+    uint8_t len;
+    uint8_t data[TX_MAX_PACKET];
+};
+SpscRing<TxPacket, TX_QUEUE_LENGTH> txQueue;
+volatile bool txDone = false;
+volatile TxStatus txStatus = TxStatus::Sent;
+
+// 868.3 MHz, 38.4 kBaud GFSK, 30/32 sync bits on 0x2dc5, whitening and CRC.
+// The register image is computed at compile time and sits in program memory.
+const RadioProfile profile PROGMEM = RadioProfile::defaults()
+        .frequency(868.3f)
+        .bitrate(38.383f)
+        .deviation(20.63f)
+        .receiverBW(101.56f)
+        .modulation(CC1101Tranceiver::Modulation::GFSK)
+        .syncType(CC1101Tranceiver::SyncType::Sync30_32)
+        .preambleLength(CC1101Tranceiver::PreambleTypes::Bytes4)
+        .syncWord(0x2d, 0xc5)
+        .crc(true)
+        .whitening(true)
+        .set(CC1101_REG_FSCTRL1, 0x06, 4, 0)
+        .set(CC1101_REG_FSCTRL0, 0x05, 7, 0);
+static_assert(RadioProfile::isValidFrequency(868.3f) && RadioProfile::isValidReceiverBW(101.56f),
+              "Invalid radio profile");
+
+// Wireless M-Bus C mode, 869.525 MHz, 100 kchip/s 2-FSK, second half of the 0x543D sync word
+const RadioProfile wmbusC PROGMEM = RadioProfile::defaults()
+        .frequency(869.525f)
+        .bitrate(100.0f)
+        .deviation(45.0f)
+        .receiverBW(325.0f)
+        .modulation(CC1101Tranceiver::Modulation::FSK2)
+        .syncType(CC1101Tranceiver::SyncType::Sync16_16)
+        .preambleLength(CC1101Tranceiver::PreambleTypes::Bytes4)
+        .syncWord(0x54, 0x3d)
+        .crc(false);
+static_assert(RadioProfile::isValidFrequency(869.525f) && RadioProfile::isValidReceiverBW(325.0f),
+              "Invalid radio profile");
+
+// 433.92 MHz, 4.8 kBaud 2-FSK on the chip default sync word
+const RadioProfile fsk433 PROGMEM = RadioProfile::defaults()
+        .frequency(433.92f)
+        .bitrate(4.8f)
+        .deviation(5.157f)
+        .receiverBW(58.0f)
+        .modulation(CC1101Tranceiver::Modulation::FSK2)
+        .syncType(CC1101Tranceiver::SyncType::Sync16_16)
+        .syncWord(0xd3, 0x91);
+static_assert(RadioProfile::isValidFrequency(433.92f) && RadioProfile::isValidReceiverBW(58.0f),
+              "Invalid radio profile");
+
+// selectable with +PROF <index>,<index>,...
+const RadioProfile *const profiles[] = {&profile, &wmbusC, &fsk433};
+
+// Protocols sent as their fields only after +FIELDS, see ProtocolLayout.h.
+// Wireless M-Bus link layer, after the L field: SND_NR or SND_IR, manufacturer, identification
+// number (BCD), version, device type and CI field.
+using WMBusLink = Protocol<1, ByteIs<0, 0x44, 0xfd>,
+        Field<1, 2>, Field<3, 4>, Field<7, 1>, Field<8, 1>, Field<9, 1>>;
+using Protocols = ProtocolSet<WMBusLink>;
+bool fieldsOutput = false;
 
 void PrintHex8(const uint8_t *data, uint8_t length, char const *separator) // prints 8-bit data in hex with leading zeroes
 {
     for (int i = 0; i < length; i++) {
-        if (data[i] < 0x10) { Serial.print("0"); }
+        if (data[i] < 0x10) { Serial.print('0'); }
         Serial.print(data[i], HEX);
 
         if (separator != nullptr) {
-            Serial.print(" ");
+            Serial.print(' ');
         }
     }
 }
@@ -72,7 +194,7 @@ void setup()
     Serial.println(F("+ccSniffer"));
     Serial.print(F("+CC1101 Initializing ... "));
 
-    auto state = radio.initialize();
+    auto state = radio.initialize(profile);
     if (state == 0) {
         Serial.println(F("success!"));
     } else {
@@ -82,145 +204,677 @@ void setup()
     }
 
     auto v = radio.getChipVersion();
-    Serial.print("+Chip version: ");
+    Serial.print(F("+Chip version: "));
     Serial.println(v);
 
-    radio.setFrequency(868.3);
-    radio.setBitrate(38.383);
-    radio.setDeviation(20.63);
-    radio.setReceiverBW(101.56);
     radio.setOutputPower(10);
 
-    radio.setModulation(CC1101Tranceiver::Modulation::GFSK);
-    radio.setSyncType(CC1101Tranceiver::SyncType::Sync30_32);
-    radio.setPreambleLength(CC1101Tranceiver::PreambleTypes::Bytes4);
-    radio.setSyncWord(0x2d, 0xc5);
-    radio.enableCRC();
-    radio.enableWhitening();
-    radio.SPIsetRegValue(CC1101_REG_FSCTRL1, 0x06, 4, 0);
-    radio.SPIsetRegValue(CC1101_REG_FSCTRL0, 0x05, 7, 0);
-
-    radio.setReceiveHandler(irqRead, CC1101Tranceiver::SignalDirection::Rising);
-    radio.setTransmitHandler(irqSent, CC1101Tranceiver::SignalDirection::Rising);
+    radio.setReceiveHandlers(allocRaw, rxComplete);
+    radio.setContinuousReceive(true);
+    radio.setReceiveHandler(irqRead, CC1101Tranceiver::SignalDirection::Change);
+    radio.setFifoHandler(irqFifo, CC1101Tranceiver::SignalDirection::Rising);
 
-    delay(500);
     radio.receive();
+    scheduler.setHome(&profile);
+
+    // time from the MCU reset to the radio listening
+    unsigned long bootUs = micros();
+    Serial.print(F("+BOOT us="));
+    Serial.println(bootUs);
+    Serial.println(F("+READY"));
+}
+
+void dumpRegisters()
+{
+    uint8_t regs[CC1101_REG_TEST0 + 1];
+    radio.SPIreadRegisterBurst(CC1101_REG_IOCFG2, sizeof(regs), regs);
 
     Serial.println(F("+CC1101 Registers dump:"));
-    for (int i = 0; i < 0x30; ++i) {
-        if ((i%8) == 0)
-            Serial.print("+");
-        uint8_t value = radio.SPIreadRegister(i);
-        PrintHex8(&value, 1, " ");
-        if (i % 8 == 7) {
-            Serial.println();
-        }
+    for (uint8_t i = 0; i < sizeof(regs); i += 8) {
+        Serial.print('+');
+        PrintHex8(&regs[i], sizeof(regs) - i < 8 ? sizeof(regs) - i : 8, " ");
+        Serial.println();
     }
+}
 
-    Serial.println("+READY");
+void irqSent(TxStatus status)
+{
+    if (status == TxStatus::Sent) {
+        ++numSent;
+    } else {
+        ++stats.txUnderflows;
+    }
+    txStatus = status;
+    txDone = true;
 }
 
-void irqSent(void)
+uint8_t *allocRaw(uint16_t len)
 {
-    ++numSent;
+    // the stamp of the sync word of this packet, whether it fits or not
+    SyncStamps<4>::Stamp stamp;
+    if (!syncStamps.take(stamp)) {
+        // its sync interrupt was missed
+        stamp.sequence = rxSequence;
+        stamp.timestamp = microsClock.now();
+    }
+
+    // the FIFO is drained straight into the queue, no intermediate buffer
+    auto raw = unprocessedQueue.reserve(len);
+    if (raw == nullptr) {
+        return nullptr;
+    }
+    raw->setSequence(stamp.sequence);
+    raw->setTimestamp(stamp.timestamp);
+    raw->setLineCode(radio.lineCode());
+    return raw->data();
+}
+
+void rxComplete(const ReadStatus &status)
+{
+    // a sync word without a length byte never took its stamp, an overflow flushes the whole FIFO
+    if (status.errc == ReadErrCode::Overflow) {
+        syncStamps.keep(0);
+    } else if (status.len == 0) {
+        syncStamps.drop();
+    }
+
+    switch (status.errc) {
+        case ReadErrCode::Ok:
+            unprocessedQueue.commit(status.len);
+            scanner.packetReceived();
+            scheduler.packetReceived();
+            break;
+        case ReadErrCode::Dropped:
+            ++stats.rawDropped;
+            break;
+        case ReadErrCode::Overflow:
+            ++stats.rxOverflow;
+            break;
+        case ReadErrCode::Discarded:
+            // dropped by the chip address check, it shows up as a gap in the sequence numbers
+            break;
+        default:
+            ++stats.rxTimeout;
+            break;
+    }
 }
 
 void irqRead(void)
 {
-    ++numRecvIrq;
-    size_t retries = 0;
-    while(true) {
-        if (++retries > 100) {
-            // timeout
-            ++numTimeout;
-            radio.receive();
-            return;
+    if (radio.isTransmitting()) {
+        // GDO0 rises on the sync word sent and falls at the end of the packet or on underflow
+        if (!radio.syncDetected()) {
+            irqSent(radio.endTransmit());
         }
-        auto fifo = radio.SPIgetRegValue(CC1101_REG_RXBYTES, 6, 0);
-        if (fifo > 0) break;
-    };
+        return;
+    }
 
-    uint8_t str[128];
-    auto status = radio.read(str, 128);
+    // GDO0 rises on sync word and falls at the end of the packet (or on RX FIFO overflow).
+    // Only stamp the packet on the rising edge, the FIFO is drained once the whole packet is in.
+    // A late falling edge looks like the rising one of the next packet, whose stamp then queues
+    // behind the one of the packet still in the FIFO.
+    if (radio.syncDetected()) {
+        ++stats.syncIrq;
+        // every sync word takes a sequence number, lost packets show up as gaps in the output
+        ++rxSequence;
+        syncStamps.latch(rxSequence, microsClock.now());
+        return;
+    }
 
-    if (status.len > 0 && status.errc != ReadErrCode::NoData) {
-        unprocessedQueue.push(str, status.len);
+    // in continuous mode this may also parse the following packets, if they are already in the FIFO
+    ++stats.fifoDrains;
+    radio.endReceive();
+    // every packet that ended is parsed: only the one arriving meanwhile may still need its stamp
+    syncStamps.keep(radio.syncDetected() ? 1 : 0);
+}
+
+void irqFifo(void)
+{
+    if (radio.isTransmitting()) {
+        // TX FIFO below threshold: load the next part of the packet
+        radio.refillTransmit();
+        return;
     }
 
-    radio.receive();
+    // RX FIFO above threshold: drain it while the rest of the packet is still arriving
+    ++stats.fifoDrains;
+    radio.drainFifo();
 }
 
 void handleUnprocessed()
 {
-    int y= 0;
+    static bool stalled = false;
+    // the packet at the head, already decoded, filtered and counted, waiting for room
+    static const RawPacket *accepted = nullptr;
+    static uint8_t acceptedLen = 0;
+    static PacketStatus acceptedStatus = PacketOK;
+    static uint8_t acceptedClass = 0;
     do {
-        noInterrupts();
-        if (unprocessedQueue.empty()) {
-            interrupts();
-/*
-            if (y>0) {
-                Serial.print(y);
-                Serial.print(" ");
-                Serial.println(queue.empty());
-            }
-*/
+        // lock free: irqRead() may keep filling the next slot while this one is processed
+        auto raw = unprocessedQueue.peek();
+        if (raw == nullptr) {
             return;
         }
+        uint16_t len = raw->len();
+        if (len < 3) {
+            unprocessedQueue.release();
+            continue;
+        }
 
-        uint8_t raw[UnprocessedQueue::MAX_PACKET_SIZE];
-        uint8_t len = unprocessedQueue.pop(raw, UnprocessedQueue::MAX_PACKET_SIZE);
-        interrupts();
+        auto fifo = raw->data();
+        uint8_t *payload = fifo + 1;
+        uint8_t rssi = fifo[len-2];
+        if (raw != accepted) {
+            bool crcOk = fifo[len-1] & 0x80;
+            acceptedStatus = crcOk ? PacketOK : CRCError;
+            if (!crcOk) {
+                ++stats.crcErrors;
+            }
+
+            // the line code of the profile is decoded in place, the decoded payload is never longer;
+            // a packet with an invalid code word keeps what was decoded before it
+            bool valid;
+            acceptedLen = decodeLineCode(raw->getLineCode(), payload, len - 3, payload, valid);
+            if (!valid) {
+                ++stats.codingErrors;
+                if (crcOk) {
+                    acceptedStatus = CodingError;
+                }
+            }
 
-        Queue::PacketType packet;
+            if (!filter.accept(payload, acceptedLen, rssi, crcOk)) {
+                ++stats.filtered;
+                unprocessedQueue.release();
+                continue;
+            }
+            accepted = raw;
+            acceptedClass = policy.classify(payload, acceptedLen, rssi, crcOk);
+        }
+
+        // known protocols are queued as their fields, the copies are compared on those
+        const uint8_t *data = payload;
+        uint8_t dataLen = acceptedLen;
+        uint8_t protocol = 0;
+        uint8_t record[PROTOCOL_MAX_RECORD];
+        if (fieldsOutput) {
+            uint8_t n = Protocols::extract(payload, acceptedLen, record, protocol);
+            if (n != 0) {
+                data = record;
+                dataLen = n;
+            }
+        }
+
+        uint16_t hash = DedupTable::hash(data, dataLen);
+        if (dedup.fold(hash, data, dataLen, acceptedStatus, rssi, raw->getTimestamp().low)) {
+            unprocessedQueue.release();
+            accepted = nullptr;
+            continue;
+        }
+
+        // shed the lower classes before the queue backs up into the raw queue, where the
+        // interrupts drop packets whatever their class
+        if (!policy.admit(acceptedClass, Queue::footprint(dataLen), queue.used(), Queue::capacity())) {
+            unprocessedQueue.release();
+            accepted = nullptr;
+            continue;
+        }
 
-        packet.setRssi(raw[len-2]);
-        packet.setLqi(raw[len-1] & 0x7f);
-        packet.setStatus((raw[len-1] & 0x80) ? PacketOK : CRCError);
-        packet.rawCopyFrom(raw+1, len-3);
+        // processed queue full: leave the raw packet where it is until handleReceived() makes room
+        auto packet = queue.reserve(dataLen);
+        if (packet == nullptr) {
+            if (!stalled) {
+                ++stats.processedStalls;
+                stalled = true;
+            }
+            return;
+        }
+        stalled = false;
 
-        queue.push(packet);
-        ++y;
+        packet->setSequence(raw->getSequence());
+        packet->setTimestamp(raw->getTimestamp());
+        packet->setRssi(rssi);
+        packet->setLqi(fifo[len-1] & 0x7f);
+        packet->setStatus(acceptedStatus);
+        packet->setProtocol(protocol);
+        packet->rawCopyFrom(data, dataLen);
+        queue.commit();
+        dedup.add(hash, packet);
+
+        unprocessedQueue.release();
+        accepted = nullptr;
     } while (true);
 }
 
+// Output mode, +BIN for frames (see Frame.h) and +TEXT for lines
+bool binaryOutput = false;
+// text may have been written since the last frame
+bool textOutput = true;
+
+// Packet being written out, a piece per loop as the serial TX buffer has room
+PacketOutput output;
+const Queue::PacketType *outputPacket = nullptr;
+
+// "+CC1101 Queue full" and CR/LF at most, the status frames are shorter
+const int statusLength = 20;
+
+// Status lines, frames and sweep records only go out between packets, and only if they fit whole
+bool outputAvailable(int len)
+{
+    return outputPacket == nullptr && Serial.availableForWrite() >= len;
+}
+
+void sendFrame(const FrameSegment *segments, uint8_t count)
+{
+    if (textOutput) {
+        Serial.write((uint8_t) 0);
+        textOutput = false;
+    }
+    writeFrame(segments, count, [](uint8_t c) { Serial.write(c); });
+}
+
+void sendStatus(FrameStatus code, uint16_t counter)
+{
+    uint8_t body[] = {static_cast<uint8_t>(FrameType::Status), static_cast<uint8_t>(code),
+                      static_cast<uint8_t>(counter), static_cast<uint8_t>(counter >> 8)};
+    FrameSegment segment{body, sizeof(body)};
+    sendFrame(&segment, 1);
+}
+
+// Writes what fits of the packets waiting in the queue, never waits for the serial port
 void handleReceived()
 {
-    if (!queue.empty()) {
-        Queue::PacketType packet;
-        if (queue.pop(packet)) {
-
-            Serial.print(F("*"));
-            Serial.print(millis());
-            Serial.print(F(","));
-            Serial.print(packet.getRssi());
-            Serial.print(F(","));
-            Serial.print(packet.getLqi());
-            Serial.print(F(","));
-            PrintHex8(packet.data(), packet.len(), nullptr);
-
-            if (packet.getStatus() == CRCError) {
-                Serial.print(",BADCRC");
+    static bool stalled = false;
+    while (true) {
+        if (outputPacket == nullptr) {
+            outputPacket = queue.peek();
+            if (outputPacket == nullptr) {
+                return;
+            }
+            // repeats of the packet may still come, they are folded into it until the window ends
+            if (dedup.held(outputPacket, micros())) {
+                outputPacket = nullptr;
+                return;
+            }
+            dedup.forget(outputPacket);
+            output.begin(outputPacket, binaryOutput, binaryOutput && textOutput);
+            if (binaryOutput) {
+                textOutput = false;
             }
-            Serial.println();
+            stalled = false;
+        }
+
+        int space = Serial.availableForWrite();
+        if (space <= 0) {
+            if (!stalled) {
+                ++stats.serialBacklog;
+                stalled = true;
+            }
+            return;
+        }
+
+        uint8_t line[OUTPUT_LINE_SIZE];
+        Serial.write(line, output.read(line, space < OUTPUT_LINE_SIZE ? space : OUTPUT_LINE_SIZE));
+        if (output.done()) {
+            latency.add(micros() - outputPacket->getTimestamp().low);
+            queue.release();
+            outputPacket = nullptr;
+        }
+    }
+}
+
+// Completes the packet being written, before a command reply
+void finishOutput()
+{
+    while (outputPacket != nullptr) {
+        handleReceived();
+    }
+}
+
+void printStats()
+{
+    PipelineStats snapshot;
+    noInterrupts();
+    snapshot.syncIrq = stats.syncIrq;
+    snapshot.fifoDrains = stats.fifoDrains;
+    snapshot.rawDropped = stats.rawDropped;
+    snapshot.rxOverflow = stats.rxOverflow;
+    snapshot.rxTimeout = stats.rxTimeout;
+    snapshot.txUnderflows = stats.txUnderflows;
+    uint16_t rawHighWater = unprocessedQueue.highWater();
+    uint16_t sequence = rxSequence;
+    uint32_t spiTransactions = radio.spiTransactions();
+    interrupts();
+
+    Serial.print(F("+STATS seq="));
+    Serial.print(sequence);
+    Serial.print(F(",sync="));
+    Serial.print(snapshot.syncIrq);
+    Serial.print(F(",drain="));
+    Serial.print(snapshot.fifoDrains);
+    Serial.print(F(",rawdrop="));
+    Serial.print(snapshot.rawDropped);
+    Serial.print(F(",overflow="));
+    Serial.print(snapshot.rxOverflow);
+    Serial.print(F(",timeout="));
+    Serial.print(snapshot.rxTimeout);
+    Serial.print(F(",stall="));
+    Serial.print(stats.processedStalls);
+    Serial.print(F(",crc="));
+    Serial.print(stats.crcErrors);
+    Serial.print(F(",code="));
+    Serial.print(stats.codingErrors);
+    Serial.print(F(",backlog="));
+    Serial.print(stats.serialBacklog);
+    Serial.print(F(",rawhw="));
+    Serial.print(rawHighWater);
+    Serial.print(F(",pkthw="));
+    Serial.print(queue.highWater());
+    Serial.print(F(",filt="));
+    Serial.print(stats.filtered);
+    Serial.print(F(",dup="));
+    Serial.print(dedup.folded());
+    Serial.print(F(",txunder="));
+    Serial.print(snapshot.txUnderflows);
+    Serial.print(F(",spi="));
+#ifdef CC1101_VERIFY_REGISTERS
+    Serial.print(spiTransactions);
+    Serial.print(F(",regerr="));
+    Serial.println(radio.registerMismatches());
+#else
+    Serial.println(spiTransactions);
+#endif
+}
+
+// Times burst reads of the configuration registers, to compare the SPI backends
+void runBenchmark()
+{
+    const uint8_t numRegs = CC1101_REG_TEST0 + 1;
+    const uint8_t rounds = 100;
+    uint8_t regs[numRegs];
+
+    // the radio stays idle meanwhile, so that its interrupts don't use the bus
+    radio.standby();
+    unsigned long start = micros();
+    for (uint8_t i = 0; i < rounds; ++i) {
+        radio.SPIreadRegisterBurst(CC1101_REG_IOCFG2, numRegs, regs);
+    }
+    unsigned long elapsed = micros() - start;
+    radio.receive();
+
+    Serial.print(F("+BENCH bytes="));
+    Serial.print((uint16_t) numRegs * rounds);
+    Serial.print(F(",us="));
+    Serial.println(elapsed);
+}
+
+void printHistogram()
+{
+    Serial.print(F("+HIST"));
+    char separator = ' ';
+    for (uint8_t i = 0; i < LatencyHistogram::BUCKETS; ++i) {
+        if (latency.buckets[i] == 0) {
+            continue;
+        }
+        Serial.print(separator);
+        Serial.print(i);
+        Serial.print(F(":"));
+        Serial.print(latency.buckets[i]);
+        separator = ',';
+    }
+    Serial.println();
+}
+
+// Pushes the filter rules down to the chip address check when they allow it
+void updateAddressFilter()
+{
+    uint8_t address = 0;
+    bool enable = filter.address(address);
+    noInterrupts();
+    radio.setAddressFilter(enable, address);
+    interrupts();
+}
+
+// Comma separated indices into profiles[]
+bool scheduleProfiles(const char *args)
+{
+    const uint8_t numProfiles = sizeof(profiles) / sizeof(profiles[0]);
+
+    scheduler.clear();
+    while (*args != '\0') {
+        if (*args < '0' || *args >= '0' + numProfiles || !scheduler.add(profiles[*args - '0'])) {
+            return false;
+        }
+        ++args;
+        if (*args == ',') {
+            ++args;
+        } else if (*args != '\0') {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Spectrum sweep, streamed as binary records:
+// '#', start frequency in Hz (uint32), step in 10 Hz (uint16), number of steps (uint8), raw RSSI bytes.
+// Multi-byte fields are little endian; dBm = (int8_t) rssi / 2 - 74.
+const uint8_t sweepHeaderSize = 8;
+bool sweeping = false;
+uint8_t sweepRecord[sweepHeaderSize + SWEEP_MAX_STEPS];
+uint32_t sweepCount = 0;
+uint32_t sweepSent = 0;
+unsigned long sweepStart = 0;
+
+void stopSweep()
+{
+    if (!sweeping) {
+        return;
+    }
+    sweeping = false;
+    noInterrupts();
+    radio.endSweep(profile);
+    interrupts();
+}
+
+// <start kHz>,<step kHz>,<steps>
+bool startSweep(const char *args)
+{
+    uint32_t values[3] = {};
+    for (uint8_t i = 0; i < 3; ++i) {
+        if (*args < '0' || *args > '9') {
+            return false;
+        }
+        while (*args >= '0' && *args <= '9') {
+            values[i] = values[i] * 10 + (*args++ - '0');
+        }
+        if (*args != (i < 2 ? ',' : '\0')) {
+            return false;
+        }
+        ++args;
+    }
+    float freq = values[0] / 1000.0f;
+    float lastFreq = (values[0] + values[1] * (values[2] - 1)) / 1000.0f;
+    if (values[2] < 2 || values[2] > SWEEP_MAX_STEPS || values[1] < 26 || values[1] > 405 ||
+        !RadioProfile::isValidFrequency(freq) || !RadioProfile::isValidFrequency(lastFreq)) {
+        return false;
+    }
+
+    stopSweep();
+    scanner.stop();
+    scheduler.stop();
+    noInterrupts();
+    radio.beginSweep(freq, values[1], values[2]);
+    interrupts();
+
+    HopChannel base;
+    radio.currentChannel(base);
+    uint32_t startHz = RadioProfile::frequencyHz(base.frf);
+    uint16_t step = radio.channelSpacing() / 10;
+    sweepRecord[0] = '#';
+    for (uint8_t i = 0; i < 4; ++i) {
+        sweepRecord[1 + i] = startHz >> (8 * i);
+    }
+    sweepRecord[5] = step;
+    sweepRecord[6] = step >> 8;
+    sweepRecord[7] = values[2];
+
+    sweepCount = 0;
+    sweepSent = 0;
+    sweepStart = micros();
+    sweeping = true;
+    return true;
+}
+
+void runSweep()
+{
+    uint8_t steps = sweepRecord[7];
+    radio.sweep(&sweepRecord[sweepHeaderSize], steps);
+    ++sweepCount;
+
+    // the radio sweeps faster than 38400 baud can carry, records that don't fit are skipped
+    uint8_t length = sweepHeaderSize + steps;
+    if (!outputAvailable(binaryOutput ? length + FrameCrcSize + 3 : length)) {
+        return;
+    }
+    if (binaryOutput) {
+        // same record, the frame type takes the place of '#'
+        uint8_t type = static_cast<uint8_t>(FrameType::Sweep);
+        FrameSegment segments[] = {{&type, 1}, {&sweepRecord[1], static_cast<uint16_t>(length - 1)}};
+        sendFrame(segments, 2);
+    } else {
+        Serial.write(sweepRecord, length);
+    }
+    ++sweepSent;
+}
+
+void printSweepStats()
+{
+    unsigned long elapsed = micros() - sweepStart;
+    Serial.print(F("+SWEEP sweeps="));
+    Serial.print(sweepCount);
+    Serial.print(F(",sent="));
+    Serial.print(sweepSent);
+    Serial.print(F(",us="));
+    Serial.print(elapsed);
+    Serial.print(F(",rate="));
+    Serial.println(elapsed != 0 ? sweepCount * 1000000.0 / elapsed : 0.0);
+}
+
+// Continuous receive never takes the chip through IDLE, where the synthesizer is calibrated:
+// renew the calibration between packets every calibrationIntervalMs
+const unsigned long calibrationIntervalMs = 60000;
+
+void recalibrate()
+{
+    static unsigned long last = 0;
+
+    if (sweeping || millis() - last < calibrationIntervalMs) {
+        return;
+    }
+    noInterrupts();
+    bool done = radio.recalibrate();
+    interrupts();
+    if (done) {
+        last = millis();
+    }
+}
+
+// Reports the end of the packet being transmitted and starts the next one
+void handleTransmit()
+{
+    static bool active = false;
+
+    if (active && txDone) {
+        if (!outputAvailable(statusLength)) {
+            return;
+        }
+        bool sent = txStatus == TxStatus::Sent;
+        if (binaryOutput) {
+            sendStatus(sent ? FrameStatus::Sent : FrameStatus::TxUnderflow, sent ? numSent : stats.txUnderflows);
+        } else {
+            Serial.println(sent ? F("+CC1101 Sent") : F("+CC1101 Underflow"));
         }
+        txDone = false;
+        txQueue.release();
+        active = false;
     }
+
+    auto packet = txQueue.peek();
+    if (active || packet == nullptr || sweeping) {
+        return;
+    }
+    noInterrupts();
+    // never cut a packet being received
+    if (!radio.packetPending()) {
+        active = radio.startTransmit(packet->data, packet->len);
+        if (!active) {
+            txQueue.release();
+        }
+    }
+    interrupts();
 }
 
+// Waits for the packet being transmitted, before a command that changes the radio setup
+void finishTransmit()
+{
+    unsigned long start = millis();
+    while (radio.isTransmitting()) {
+        if (millis() - start > 500) {
+            // GDO0 never fell, give up on the packet
+            noInterrupts();
+            radio.receive();
+            irqSent(TxStatus::Underflow);
+            interrupts();
+        }
+    }
+}
 
-int cacheNumSent = -1, cachedNumTo = -1;
+int cacheNumSent = -1, cachedNumTo = -1, cachedNumOverflow = 0, cachedNumDropped = 0;
 int cachedNumIrq = -1;
 
 void loop()
 {
-    if (cachedNumTo != numTimeout) {
-        Serial.println("+CC1101 Timeout");
-        cachedNumTo = numTimeout;
+    // keeps the rollover extension of the timestamps alive when no packets are received
+    noInterrupts();
+    microsClock.now();
+    interrupts();
+
+    // one status a loop
+    if (outputAvailable(statusLength)) {
+        // the interrupts update the counters, a 16 bit read on AVR takes two loads
+        noInterrupts();
+        uint16_t rxTimeout = stats.rxTimeout;
+        uint16_t rxOverflow = stats.rxOverflow;
+        uint16_t rawDropped = stats.rawDropped;
+        interrupts();
+
+        if (cachedNumTo != rxTimeout) {
+            cachedNumTo = rxTimeout;
+            if (binaryOutput) {
+                sendStatus(FrameStatus::Timeout, cachedNumTo);
+            } else {
+                Serial.println(F("+CC1101 Timeout"));
+            }
+        } else if (cachedNumOverflow != rxOverflow) {
+            cachedNumOverflow = rxOverflow;
+            if (binaryOutput) {
+                sendStatus(FrameStatus::Overflow, cachedNumOverflow);
+            } else {
+                Serial.println(F("+CC1101 Overflow"));
+            }
+        } else if (cachedNumDropped != rawDropped) {
+            cachedNumDropped = rawDropped;
+            if (binaryOutput) {
+                sendStatus(FrameStatus::QueueFull, cachedNumDropped);
+            } else {
+                Serial.println(F("+CC1101 Queue full"));
+            }
+        }
     }
 /*
-    if (cachedNumIrq != numRecvIrq) {
+    if (cachedNumIrq != stats.syncIrq) {
         Serial.print("+CC1101 IRQ:");
-        Serial.println(numRecvIrq);
-        cachedNumIrq = numRecvIrq;
+        Serial.println(stats.syncIrq);
+        cachedNumIrq = stats.syncIrq;
     }
 */
 /*
@@ -234,26 +888,195 @@ void loop()
 */
 
     if (serial.lineAvailable()) {
-        static char buf[128];
-        auto sz = serial.copyLine(buf,128);
-        buf[sz] = '\0';
+        char *buf = serial.line();
 //        Serial.print("Got ");
 //        Serial.print(sz);
 //        Serial.print(": ");
 //        Serial.println(buf);
 
-        static uint8_t pkt[64];
-        auto pktlen = hexToBin(buf,pkt,64);
-        radio.transmit(pkt, pktlen);
+        // command replies are text and may block; the next frame starts with a delimiter
+        finishOutput();
+        textOutput = true;
+
+        const char *args;
+        SerialCommand command = SerialHandler::parseCommand(buf, &args);
+        if (command != SerialCommand::Transmit) {
+            finishTransmit();
+        }
+        switch (command) {
+            case SerialCommand::Transmit: {
+                if (serial.truncated() || strlen(args) > 2 * TX_MAX_PACKET) {
+                    Serial.println(F("+ERR packet too long"));
+                    break;
+                }
+                auto packet = txQueue.reserve();
+                if (packet == nullptr) {
+                    Serial.println(F("+ERR transmit queue full"));
+                    break;
+                }
+                packet->len = hexToBin(args, packet->data, sizeof(packet->data));
+                if (packet->len > 0) {
+                    txQueue.commit();
+                }
+                break;
+            }
+            case SerialCommand::Stats:
+                printStats();
+                break;
+            case SerialCommand::Histogram:
+                printHistogram();
+                break;
+            case SerialCommand::Benchmark:
+                runBenchmark();
+                break;
+            case SerialCommand::Registers:
+                dumpRegisters();
+                break;
+            case SerialCommand::Scan:
+                if (*args == '\0') {
+                    scanner.printStats();
+                    break;
+                }
+                // channel numbers are relative to the base frequency of the home setup
+                stopSweep();
+                scheduler.stop();
+                if (scanner.configure(args)) {
+                    scanner.start();
+                    Serial.println(F("+OK"));
+                } else {
+                    Serial.println(F("+ERR bad channel list"));
+                }
+                break;
+            case SerialCommand::Profiles:
+                if (*args == '\0') {
+                    scheduler.printStats();
+                } else if (scheduleProfiles(args)) {
+                    stopSweep();
+                    scanner.stop();
+                    scheduler.start();
+                    Serial.println(F("+OK"));
+                } else {
+                    Serial.println(F("+ERR bad profile list"));
+                }
+                break;
+            case SerialCommand::Sweep:
+                if (*args == '\0') {
+                    printSweepStats();
+                } else if (startSweep(args)) {
+                    Serial.println(F("+OK"));
+                } else {
+                    Serial.println(F("+ERR bad sweep"));
+                }
+                break;
+            case SerialCommand::Filter:
+                if (*args == '\0') {
+                    filter.printRules();
+                } else if (strcmp_P(args, PSTR("clear")) == 0) {
+                    filter.clear();
+                    updateAddressFilter();
+                    Serial.println(F("+OK"));
+                } else if (filter.addRule(args)) {
+                    updateAddressFilter();
+                    Serial.println(F("+OK"));
+                } else {
+                    Serial.println(F("+ERR bad filter rule"));
+                }
+                break;
+            case SerialCommand::Dedup: {
+                if (*args == '\0') {
+                    Serial.print(F("+DEDUP window="));
+                    Serial.print(dedup.window());
+                    Serial.print(F(",folded="));
+                    Serial.println(dedup.folded());
+                    break;
+                }
+                char *end;
+                unsigned long ms = strtoul(args, &end, 10);
+                if (*end != '\0' || ms > 10000 || !dedup.setWindow(ms)) {
+                    Serial.println(F("+ERR bad window"));
+                    break;
+                }
+                Serial.println(F("+OK"));
+                break;
+            }
+            case SerialCommand::Classes: {
+                if (*args == '\0') {
+                    policy.printStats();
+                    break;
+                }
+                if (strcmp_P(args, PSTR("clear")) == 0) {
+                    policy.clear();
+                    Serial.println(F("+OK"));
+                    break;
+                }
+                // <class> share=<percent> or <class> <conditions>
+                uint8_t cls = args[0] - '0';
+                bool ok = args[1] == ' ';
+                if (ok && strncmp_P(&args[2], PSTR("share="), 6) == 0) {
+                    char *end;
+                    unsigned long percent = strtoul(&args[8], &end, 10);
+                    ok = *end == '\0' && end != &args[8] && percent <= 100 && policy.setShare(cls, percent);
+                } else if (ok) {
+                    ok = policy.addRule(cls, &args[2]);
+                }
+                Serial.println(ok ? F("+OK") : F("+ERR bad class"));
+                break;
+            }
+            case SerialCommand::Fields:
+                if (strcmp_P(args, PSTR("on")) == 0 || strcmp_P(args, PSTR("off")) == 0) {
+                    fieldsOutput = args[1] == 'n';
+                    Serial.println(F("+OK"));
+                } else {
+                    Serial.println(F("+ERR on or off"));
+                }
+                break;
+            case SerialCommand::Binary:
+                binaryOutput = true;
+                Serial.println(F("+OK"));
+                break;
+            case SerialCommand::Text:
+                binaryOutput = false;
+                Serial.println(F("+OK"));
+                break;
+            case SerialCommand::Stop:
+                stopSweep();
+                scanner.stop();
+                scheduler.stop();
+                break;
+            case SerialCommand::Unknown:
+                Serial.println(F("+ERR unknown command"));
+                break;
+        }
 
 //        Serial.print("Sent ");
 //        Serial.print(sn);
 //        Serial.print(": ");
 //        PrintHex8(pkt, pktlen, " ");
+        serial.nextLine();
     }
 
+    if (sweeping) {
+        runSweep();
+    }
+    scanner.poll();
+    scheduler.poll();
+    recalibrate();
+    handleTransmit();
     handleUnprocessed();
     handleReceived();
 }
 
 
+
+#if defined (STATIC_RAM_BUDGET) && defined (__AVR__)
+// On the target only, host builds of the sources have wider pointers and padding
+static_assert(sizeof(radio) + sizeof(unprocessedQueue) + sizeof(queue) + sizeof(serial) + sizeof(scanner) +
+              sizeof(scheduler) + sizeof(filter) + sizeof(dedup) + sizeof(policy) + sizeof(stats) +
+              sizeof(latency) + sizeof(txQueue) + sizeof(output) + sizeof(sweepRecord) +
+              SERIAL_RX_BUFFER_SIZE + SERIAL_TX_BUFFER_SIZE <= STATIC_RAM_BUDGET,
+              "Static data over the RAM budget of the board");
+// loop() only writes what fits: the TX buffer must hold several sweep records and output lines
+static_assert(SERIAL_TX_BUFFER_SIZE >= 4 * (sweepHeaderSize + SWEEP_MAX_STEPS + FrameCrcSize + 3) &&
+              SERIAL_TX_BUFFER_SIZE >= 8 * OUTPUT_LINE_SIZE,
+              "Serial TX buffer too small for the output, see platformio.ini");
+#endif
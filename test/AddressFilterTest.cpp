@@ -0,0 +1,93 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+// Address check offload: the packets the chip drops are told apart from timeouts, and profiles with
+// a line code keep the check off.
+
+#include "RadioTest.h"
+
+const RadioProfile plain = RadioProfile::defaults();
+const RadioProfile coded = RadioProfile::defaults().lineCode(LineCode::ThreeOfSix);
+
+static uint8_t addressCheck()
+{
+    return chip.regs[CC1101_REG_PKTCTRL1] & 0x03;
+}
+
+// The chip reads the length and address bytes, then takes them back out of the FIFO
+static void discardedPacket()
+{
+    const uint8_t head[] = {10, 0x45};
+    chip.startPacket();
+    feed(head, sizeof(head));
+    endPacket(true);
+}
+
+static void discards()
+{
+    startReceiver(plain);
+    radio.setAddressFilter(true, 0x44);
+    chip.advance(1000);
+    CHECK_EQUAL(addressCheck(), CC1101_ADR_CHK_NO_BROADCAST);
+    CHECK_EQUAL(chip.regs[CC1101_REG_ADDR], 0x44);
+
+    discardedPacket();
+    CHECK_EQUAL(failed.size(), 1);
+    CHECK(failed[0] == ReadErrCode::Discarded);
+    CHECK(received.empty());
+
+    // the packets that pass still come through
+    Bytes bytes = packet(10, 0x44);
+    receivePacket(bytes);
+    CHECK_EQUAL(received.size(), 1);
+    CHECK(received[0] == bytes);
+    CHECK_EQUAL(failed.size(), 1);
+
+    // without the check an end of packet without data is a timeout
+    clearReceived();
+    radio.setAddressFilter(false);
+    chip.advance(1000);
+    CHECK_EQUAL(addressCheck(), CC1101_ADR_CHK_NONE);
+    chip.startPacket();
+    endPacket();
+    CHECK_EQUAL(failed.size(), 1);
+    CHECK(failed[0] == ReadErrCode::NoData);
+}
+
+static void lineCodes()
+{
+    // enabled on a line coded profile: left to the filter rules
+    startReceiver(coded);
+    radio.setAddressFilter(true, 0x44);
+    chip.advance(1000);
+    CHECK_EQUAL(addressCheck(), CC1101_ADR_CHK_NONE);
+    chip.startPacket();
+    endPacket();
+    CHECK_EQUAL(failed.size(), 1);
+    CHECK(failed[0] == ReadErrCode::NoData);
+
+    // and across profile changes
+    radio.applyProfile(plain);
+    CHECK_EQUAL(addressCheck(), CC1101_ADR_CHK_NO_BROADCAST);
+    radio.applyProfile(coded);
+    CHECK_EQUAL(addressCheck(), CC1101_ADR_CHK_NONE);
+
+    uint8_t plainCal[3];
+    uint8_t codedCal[3];
+    radio.setFastHopping(true);
+    radio.calibrateProfile(plain, plainCal);
+    radio.calibrateProfile(coded, codedCal);
+    radio.switchProfile(plain, plainCal);
+    CHECK_EQUAL(addressCheck(), CC1101_ADR_CHK_NO_BROADCAST);
+    CHECK_EQUAL(chip.regs[CC1101_REG_ADDR], 0x44);
+    radio.switchProfile(coded, codedCal);
+    CHECK_EQUAL(addressCheck(), CC1101_ADR_CHK_NONE);
+}
+
+int main()
+{
+    discards();
+    lineCodes();
+    return checkResult();
+}
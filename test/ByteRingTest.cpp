@@ -0,0 +1,233 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+// ByteRing records across the end of the buffer: wrap markers, wasted tails and a random
+// producer / consumer run against a plain queue. Then the capacity of the Nano rings for bursts of
+// mixed sizes, against the fixed slot queues they replaced.
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include "Check.h"
+#include "ByteRing.h"
+#include "PacketQueue.h"
+
+typedef ByteRing<8> SmallRing;
+
+static bool write(SmallRing &ring, uint16_t len, uint8_t seed)
+{
+    uint8_t *data = ring.reserve(len);
+    if (data == nullptr) {
+        return false;
+    }
+    for (uint16_t i = 0; i < len; ++i) {
+        data[i] = seed + i;
+    }
+    ring.commit(len);
+    return true;
+}
+
+static bool readBack(SmallRing &ring, uint16_t len, uint8_t seed)
+{
+    uint16_t got;
+    const uint8_t *data = ring.peek(got);
+    if (data == nullptr || got != len) {
+        return false;
+    }
+    for (uint16_t i = 0; i < len; ++i) {
+        if (data[i] != static_cast<uint8_t>(seed + i)) {
+            return false;
+        }
+    }
+    ring.release();
+    return true;
+}
+
+static void wrapMarker()
+{
+    // 32 bytes in 8 blocks: records of 8 bytes take 3 blocks with the header
+    SmallRing ring;
+    CHECK(write(ring, 8, 1));
+    CHECK(write(ring, 8, 2));
+    CHECK_EQUAL(ring.used(), 24);
+    // 2 blocks left at the end but 3 needed, and the start is still taken
+    CHECK(!write(ring, 8, 3));
+    CHECK(readBack(ring, 8, 1));
+
+    // now it fits at the start, the tail of the buffer is wasted
+    CHECK(write(ring, 8, 3));
+    CHECK_EQUAL(ring.used(), 32);
+    CHECK(readBack(ring, 8, 2));
+    // the consumer skips the marker
+    CHECK(readBack(ring, 8, 3));
+    CHECK(ring.empty());
+    CHECK_EQUAL(ring.highWater(), 32);
+}
+
+static void shortCommit()
+{
+    SmallRing ring;
+    uint8_t *data = ring.reserve(SmallRing::MAX_RECORD_SIZE);
+    CHECK(data != nullptr);
+    CHECK(ring.reserve(SmallRing::MAX_RECORD_SIZE + 1) == nullptr);
+    data[0] = 0x55;
+    ring.commit(1);
+    CHECK_EQUAL(ring.used(), 8);
+
+    uint16_t len;
+    const uint8_t *record = ring.peek(len);
+    CHECK(record == data);
+    CHECK_EQUAL(len, 1);
+    ring.release();
+    CHECK(ring.empty());
+    CHECK(ring.peek(len) == nullptr);
+}
+
+static void randomRun()
+{
+    // free running 8 bit indices wrap many times over
+    ByteRing<64> ring;
+    std::deque<std::vector<uint8_t>> expected;
+    uint32_t seed = 1;
+    long written = 0;
+    long wrapped = 0;
+    const uint8_t *last = nullptr;
+    for (int step = 0; step < 100000; ++step) {
+        seed = seed * 1103515245 + 12345;
+        if ((seed >> 16) % 3 != 0) {
+            uint16_t len = (seed >> 8) % 80;
+            uint8_t *data = ring.reserve(len);
+            if (data == nullptr) {
+                continue;
+            }
+            std::vector<uint8_t> record(len);
+            for (uint16_t i = 0; i < len; ++i) {
+                record[i] = data[i] = static_cast<uint8_t>(seed + i);
+            }
+            ring.commit(len);
+            expected.push_back(record);
+            ++written;
+        } else if (!expected.empty()) {
+            uint16_t len;
+            const uint8_t *data = ring.peek(len);
+            CHECK(data != nullptr);
+            if (data == nullptr) {
+                break;
+            }
+            const std::vector<uint8_t> &record = expected.front();
+            CHECK_EQUAL(len, record.size());
+            CHECK(std::equal(record.begin(), record.end(), data));
+            if (data < last) {
+                ++wrapped;
+            }
+            last = data;
+            ring.release();
+            expected.pop_front();
+        }
+    }
+    CHECK(written > 10000);
+    CHECK(wrapped > 1000);
+    CHECK_EQUAL(ring.empty(), expected.empty());
+}
+
+// Payload length of a frame in a burst: mostly 10-20 bytes, a tail of longer ones up to 230
+static uint8_t burstLength(uint32_t &seed)
+{
+    seed = seed * 1103515245 + 12345;
+    uint8_t kind = (seed >> 16) % 100;
+    uint8_t n = seed >> 8;
+    if (kind < 70) {
+        return 10 + n % 11;
+    } else if (kind < 90) {
+        return 21 + n % 20;
+    } else if (kind < 97) {
+        return 41 + n % 40;
+    }
+    return 81 + n % 150;
+}
+
+// A burst of frames arriving faster than the loop takes them: how many the queues hold whole
+static const int burstFrames = 40;
+
+// The old RawPacketsQueue<4,64> and PacketsQueue<4,64>: the first 4 frames take the 64 byte slots,
+// the longer ones truncated
+static int fixedSlots(uint32_t seed, uint8_t overhead)
+{
+    int whole = 0;
+    for (int slot = 0; slot < 4; ++slot) {
+        if (burstLength(seed) + overhead <= 64) {
+            ++whole;
+        }
+    }
+    return whole;
+}
+
+static int rawRing(uint32_t seed)
+{
+    RawPacketsQueue<64, 4> queue;
+    int whole = 0;
+    for (int frame = 0; frame < burstFrames; ++frame) {
+        // the length byte, RSSI and LQI of the FIFO with the payload
+        uint16_t len = burstLength(seed) + 3;
+        if (queue.reserve(len) != nullptr) {
+            queue.commit(len);
+            ++whole;
+        }
+    }
+    return whole;
+}
+
+static int packetRing(uint32_t seed)
+{
+    static const uint8_t payload[255] = {};
+    PacketsQueue<64, 4> queue;
+    int whole = 0;
+    for (int frame = 0; frame < burstFrames; ++frame) {
+        uint8_t len = burstLength(seed);
+        Packet *packet = queue.reserve(len);
+        if (packet != nullptr) {
+            packet->rawCopyFrom(payload, len);
+            queue.commit();
+            ++whole;
+        }
+    }
+    return whole;
+}
+
+static void capacity()
+{
+    // the Nano rings take the RAM of the slots they replaced, the packet headers included
+    CHECK((ByteRing<64, 4>::CAPACITY <= 4 * 64));
+
+    const int bursts = 1000;
+    long raw = 0;
+    long processed = 0;
+    long rawSlots = 0;
+    long processedSlots = 0;
+    uint32_t seed = 1;
+    for (int burst = 0; burst < bursts; ++burst) {
+        rawSlots += fixedSlots(seed, 3);
+        processedSlots += fixedSlots(seed, 0);
+        raw += rawRing(seed);
+        processed += packetRing(seed);
+        burstLength(seed);
+    }
+    printf("frames held whole in a burst: raw ring %.1f, 64 byte slots %.1f; processed ring %.1f, 64 byte slots %.1f\n",
+           raw / double(bursts), rawSlots / double(bursts), processed / double(bursts), processedSlots / double(bursts));
+    // the ring and packet headers, 16 to 20 bytes a frame, eat into the gain on the short frames
+    CHECK(10 * raw > 14 * rawSlots);
+    CHECK(10 * processed > 14 * processedSlots);
+    // slots long enough for the whole range, 255 bytes, would fit a single frame in that RAM
+    CHECK(raw > 5 * bursts);
+    CHECK(processed > 5 * bursts);
+}
+
+int main()
+{
+    wrapMarker();
+    shortCommit();
+    randomRun();
+    capacity();
+    return checkResult();
+}
@@ -0,0 +1,80 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+// Channel lists of +SCAN, and hops restoring the cached calibration of each channel.
+
+#include "RadioTest.h"
+#include "ChannelScanner.h"
+
+static void channelLists()
+{
+    startReceiver();
+    ChannelScanner scanner(radio);
+    CHECK(scanner.configure("c0:50,c4:50,f869525:200"));
+    CHECK(scanner.configure("f315000,f433920,f915000"));
+    CHECK(scanner.configure("c255"));
+
+    // outside the bands of the chip, or at their edges
+    for (const char *bad : {"f300000", "f350000", "f380000", "f500000", "f700000", "f928000", "f1000000", "f0"}) {
+        if (scanner.configure(bad)) {
+            fprintf(stderr, "\"%s\" accepted\n", bad);
+            ++checkFailures;
+        }
+    }
+    for (const char *bad : {"", "c256", "c1:0", "c1:70000", "x1", "c1;c2", "f868000:"}) {
+        if (scanner.configure(bad)) {
+            fprintf(stderr, "\"%s\" accepted\n", bad);
+            ++checkFailures;
+        }
+    }
+    // one channel too many
+    std::string list = "c0";
+    for (int i = 1; i < SCAN_MAX_CHANNELS; ++i) {
+        list += ",c" + std::to_string(i);
+    }
+    CHECK(scanner.configure(list.c_str()));
+    list += ",c99";
+    CHECK(!scanner.configure(list.c_str()));
+}
+
+static void hops()
+{
+    startReceiver();
+    ChannelScanner scanner(radio);
+    CHECK(scanner.configure("f868300:10,f869525:10"));
+    scanner.start();
+    CHECK(scanner.active());
+    long calibrations = chip.calibrations;
+
+    uint8_t fscal[2][3];
+    uint8_t freq0[2];
+    for (int i = 0; i < 4; ++i) {
+        chip.advance(11000);
+        scanner.poll();
+        memcpy(fscal[i % 2], &chip.regs[CC1101_REG_FSCAL3], 3);
+        freq0[i % 2] = chip.regs[CC1101_REG_FREQ0];
+    }
+    CHECK(freq0[0] != freq0[1]);
+    CHECK(memcmp(fscal[0], fscal[1], 3) != 0);
+    // hops reuse the calibrations made by start()
+    CHECK_EQUAL(chip.calibrations, calibrations);
+
+    // never while a packet is arriving
+    chip.advance(11000);
+    chip.startPacket();
+    uint8_t before = chip.regs[CC1101_REG_FREQ0];
+    scanner.poll();
+    CHECK_EQUAL(chip.regs[CC1101_REG_FREQ0], before);
+    endPacket();
+
+    scanner.stop();
+    CHECK(!scanner.active());
+}
+
+int main()
+{
+    channelLists();
+    hops();
+    return checkResult();
+}
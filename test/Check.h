@@ -0,0 +1,41 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+#ifndef CCSNIFFER_CHECK_H
+#define CCSNIFFER_CHECK_H
+
+#include <stdio.h>
+
+// Minimal assertions for the host tests: a failed check is reported and the test carries on,
+// main() returns checkResult() so that ctest sees the failure.
+static int checkFailures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            ++checkFailures; \
+        } \
+    } while (0)
+
+#define CHECK_EQUAL(actual, expected) \
+    do { \
+        long long actualValue = static_cast<long long>(actual); \
+        long long expectedValue = static_cast<long long>(expected); \
+        if (actualValue != expectedValue) { \
+            fprintf(stderr, "%s:%d: check failed: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, \
+                    actualValue, expectedValue); \
+            ++checkFailures; \
+        } \
+    } while (0)
+
+inline int checkResult()
+{
+    if (checkFailures != 0) {
+        fprintf(stderr, "%d checks failed\n", checkFailures);
+    }
+    return checkFailures != 0 ? 1 : 0;
+}
+
+#endif //CCSNIFFER_CHECK_H
@@ -0,0 +1,517 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+#include <Arduino.h>
+#include <SPI.h>
+#include <stdio.h>
+#include "ChipMock.h"
+#include "RadioProfile.h"
+
+ChipMock chip;
+HardwareSerial Serial;
+SPIClass SPI;
+
+void ChipMock::reset()
+{
+    memcpy(regs, RadioProfile::resetValues().regs, sizeof(regs));
+    memset(patable, 0, sizeof(patable));
+    patable[0] = 0xc6;
+    rx.clear();
+    tx.clear();
+    marc = CC1101_MARC_STATE_IDLE;
+    rssi = 0x80;
+    sync = false;
+
+    now = 0;
+    transactions = 0;
+    bytes = 0;
+    blocks = 0;
+    strobes = 0;
+    calibrations = 0;
+    blindUs = 0;
+    rxExits = 0;
+
+    mPending = 0;
+    mPendingUntil = 0;
+    mPendingCalibration = false;
+    mIdleTransitions = 0;
+    mRxLeft = 0;
+    mSelected = false;
+    mHeader = 0;
+    mCount = 0;
+    mPacketStart = 0;
+    mTxLeft = 0;
+}
+
+void ChipMock::advance(unsigned long us)
+{
+    now += us;
+    update();
+}
+
+void ChipMock::update()
+{
+    if (mPendingUntil != 0 && now >= mPendingUntil) {
+        unsigned long at = mPendingUntil;
+        mPendingUntil = 0;
+        if (mPendingCalibration) {
+            mPendingCalibration = false;
+            calibrate();
+        }
+        setMarc(mPending, at);
+    }
+}
+
+void ChipMock::setMarc(uint8_t state)
+{
+    setMarc(state, now);
+}
+
+void ChipMock::setMarc(uint8_t state, unsigned long at)
+{
+    if (marc == CC1101_MARC_STATE_RX && state != CC1101_MARC_STATE_RX) {
+        mRxLeft = at;
+        ++rxExits;
+    } else if (marc != CC1101_MARC_STATE_RX && state == CC1101_MARC_STATE_RX && rxExits > 0) {
+        blindUs += at - mRxLeft;
+    }
+    marc = state;
+}
+
+void ChipMock::startPacket()
+{
+    update();
+    if (marc == CC1101_MARC_STATE_RX) {
+        sync = true;
+        mPacketStart = rx.size();
+    }
+}
+
+void ChipMock::receiveBytes(const uint8_t *data, size_t len)
+{
+    update();
+    for (size_t i = 0; i < len && marc == CC1101_MARC_STATE_RX && sync; ++i) {
+        if (rx.size() == CC1101_FIFO_SIZE) {
+            setMarc(CC1101_MARC_STATE_RXFIFO_OVERFLOW);
+            sync = false;
+            return;
+        }
+        rx.push_back(data[i]);
+    }
+}
+
+void ChipMock::endPacket(bool discarded)
+{
+    update();
+    if (!sync) {
+        return;
+    }
+    sync = false;
+    if (discarded) {
+        // address or length check failed: the packet handler rewinds the FIFO
+        rx.resize(mPacketStart);
+    }
+
+    switch (regs[CC1101_REG_MCSM1] & 0x0c) {
+        case CC1101_RXOFF_IDLE:
+            goIdle();
+            break;
+        case CC1101_RXOFF_FSTXON:
+            setMarc(CC1101_MARC_STATE_FSTXON);
+            break;
+        case CC1101_RXOFF_TX:
+            setMarc(CC1101_MARC_STATE_TX);
+            break;
+        default:
+            // RXOFF = RX: straight back to RX, the synthesizer is not touched
+            break;
+    }
+}
+
+bool ChipMock::transmitByte()
+{
+    update();
+    if (marc != CC1101_MARC_STATE_TX) {
+        return false;
+    }
+    if (tx.empty()) {
+        setMarc(CC1101_MARC_STATE_TXFIFO_UNDERFLOW);
+        sync = false;
+        return false;
+    }
+
+    uint8_t data = tx.front();
+    tx.pop_front();
+    if (mTxLeft == 0) {
+        // length byte of a variable length packet
+        mTxLeft = data + 1;
+        sync = true;
+    }
+    if (--mTxLeft == 0) {
+        sync = false;
+        if ((regs[CC1101_REG_MCSM1] & 0x03) == 0x03) {
+            setMarc(CC1101_MARC_STATE_RX);
+        } else {
+            goIdle();
+        }
+        return false;
+    }
+    return true;
+}
+
+void ChipMock::select(bool selected)
+{
+    mSelected = selected;
+    mCount = 0;
+}
+
+uint8_t ChipMock::transfer(uint8_t data)
+{
+    ++bytes;
+    ++now;
+    update();
+    if (!mSelected) {
+        return 0xff;
+    }
+
+    if (mCount++ == 0) {
+        mHeader = data;
+        ++transactions;
+        uint8_t addr = data & 0x3f;
+        uint8_t reply = status((data & 0x80) == 0);
+        if (addr >= 0x30 && addr <= 0x3d && (data & 0x40) == 0) {
+            ++strobes;
+            strobe(addr);
+        }
+        return reply;
+    }
+
+    bool read = (mHeader & 0x80) != 0;
+    bool burst = (mHeader & 0x40) != 0;
+    uint8_t addr = mHeader & 0x3f;
+    uint8_t offset = burst ? mCount - 2 : 0;
+
+    if (addr == CC1101_REG_FIFO) {
+        if (read) {
+            if (rx.empty()) {
+                return 0;
+            }
+            uint8_t value = rx.front();
+            rx.pop_front();
+            return value;
+        }
+        if (tx.size() < CC1101_FIFO_SIZE) {
+            tx.push_back(data);
+        }
+        return status(true);
+    }
+    if (addr == CC1101_REG_PATABLE) {
+        uint8_t &entry = patable[offset & 7];
+        if (read) {
+            return entry;
+        }
+        entry = data;
+        return status(true);
+    }
+    if (addr >= 0x30 && burst && read) {
+        return readStatusRegister(addr);
+    }
+
+    uint8_t reg = addr + offset;
+    if (reg >= sizeof(regs)) {
+        return 0;
+    }
+    if (read) {
+        return regs[reg];
+    }
+    regs[reg] = data;
+    return status(true);
+}
+
+bool ChipMock::signal(uint8_t config)
+{
+    update();
+    bool value;
+    switch (config & 0x3f) {
+        case CC1101_GDOX_RX_FIFO_FULL:
+        case CC1101_GDOX_RX_FIFO_FULL_OR_PKT_END:
+            value = rx.size() >= rxThreshold();
+            break;
+        case CC1101_GDOX_TX_FIFO_ABOVE_THR:
+            value = tx.size() >= txThreshold();
+            break;
+        case CC1101_GDOX_TX_FIFO_FULL:
+            value = tx.size() == CC1101_FIFO_SIZE;
+            break;
+        case CC1101_GDOX_RX_FIFO_OVERFLOW:
+            value = marc == CC1101_MARC_STATE_RXFIFO_OVERFLOW;
+            break;
+        case CC1101_GDOX_TX_FIFO_UNDERFLOW:
+            value = marc == CC1101_MARC_STATE_TXFIFO_UNDERFLOW;
+            break;
+        case CC1101_GDOX_SYNC_WORD_SENT_OR_RECEIVED:
+            value = sync;
+            break;
+        default:
+            value = false;
+            break;
+    }
+    return (config & 0x40) ? !value : value;
+}
+
+uint8_t ChipMock::status(bool write)
+{
+    uint8_t state;
+    switch (marc) {
+        case CC1101_MARC_STATE_IDLE:
+            state = 0;
+            break;
+        case CC1101_MARC_STATE_RX:
+            state = 1;
+            break;
+        case CC1101_MARC_STATE_TX:
+            state = 2;
+            break;
+        case CC1101_MARC_STATE_FSTXON:
+            state = 3;
+            break;
+        case CC1101_MARC_STATE_IFADCON:
+            state = 5;
+            break;
+        case CC1101_MARC_STATE_RXFIFO_OVERFLOW:
+            state = 6;
+            break;
+        case CC1101_MARC_STATE_TXFIFO_UNDERFLOW:
+            state = 7;
+            break;
+        default:
+            state = 4;
+            break;
+    }
+    size_t bytes = write ? CC1101_FIFO_SIZE - tx.size() : rx.size();
+    return static_cast<uint8_t>(state << 4) | static_cast<uint8_t>(bytes > 15 ? 15 : bytes);
+}
+
+uint8_t ChipMock::readStatusRegister(uint8_t reg)
+{
+    // TXBYTES and RXBYTES are defined with the status register access bit, reg is the address
+    switch (reg) {
+        case CC1101_REG_VERSION:
+            return CC1101_VERSION_CURRENT;
+        case CC1101_REG_RSSI:
+            return rssi;
+        case CC1101_REG_MARCSTATE:
+            return marc;
+        case CC1101_REG_TXBYTES & 0x3f:
+            return (marc == CC1101_MARC_STATE_TXFIFO_UNDERFLOW ? 0x80 : 0) | static_cast<uint8_t>(tx.size());
+        case CC1101_REG_RXBYTES & 0x3f:
+            return (marc == CC1101_MARC_STATE_RXFIFO_OVERFLOW ? 0x80 : 0) | static_cast<uint8_t>(rx.size());
+        default:
+            return 0;
+    }
+}
+
+void ChipMock::strobe(uint8_t command)
+{
+    bool calibrating = mPendingUntil != 0 && mPending == CC1101_MARC_STATE_IDLE;
+    switch (command) {
+        case CC1101_CMD_RESET: {
+            ChipMock counters = *this;
+            reset();
+            now = counters.now;
+            transactions = counters.transactions;
+            bytes = counters.bytes;
+            blocks = counters.blocks;
+            strobes = counters.strobes;
+            mSelected = true;
+            mCount = 1;
+            break;
+        }
+        case CC1101_CMD_CAL:
+            if (marc == CC1101_MARC_STATE_IDLE) {
+                setMarc(CC1101_MARC_STATE_MANCAL);
+                mPending = CC1101_MARC_STATE_IDLE;
+                mPendingUntil = now + CalibrationUs;
+                mPendingCalibration = true;
+            }
+            break;
+        case CC1101_CMD_RX:
+        case CC1101_CMD_TX: {
+            uint8_t target = command == CC1101_CMD_RX ? CC1101_MARC_STATE_RX : CC1101_MARC_STATE_TX;
+            if (calibrating) {
+                // taken once the calibration is over
+                mPending = target;
+                mPendingUntil += SettlingUs;
+            } else if (marc == CC1101_MARC_STATE_IDLE) {
+                bool autoCal = (regs[CC1101_REG_MCSM0] & 0x30) == CC1101_FS_AUTOCAL_IDLE_TO_RXTX;
+                setMarc(autoCal ? CC1101_MARC_STATE_STARTCAL : CC1101_MARC_STATE_IFADCON);
+                mPending = target;
+                mPendingUntil = now + (autoCal ? CalibratedSettlingUs : SettlingUs);
+                mPendingCalibration = autoCal;
+            } else if (marc == CC1101_MARC_STATE_RX || marc == CC1101_MARC_STATE_TX ||
+                       marc == CC1101_MARC_STATE_FSTXON) {
+                setMarc(target);
+            }
+            break;
+        }
+        case CC1101_CMD_IDLE:
+            if (mPendingUntil != 0 && !calibrating) {
+                // settling abandoned
+                mPendingUntil = 0;
+                mPendingCalibration = false;
+                setMarc(CC1101_MARC_STATE_IDLE);
+            } else if (!calibrating) {
+                sync = false;
+                goIdle();
+            }
+            break;
+        case CC1101_CMD_FLUSH_RX:
+            if (marc == CC1101_MARC_STATE_IDLE || marc == CC1101_MARC_STATE_RXFIFO_OVERFLOW) {
+                rx.clear();
+                if (marc == CC1101_MARC_STATE_RXFIFO_OVERFLOW) {
+                    setMarc(CC1101_MARC_STATE_IDLE);
+                }
+            }
+            break;
+        case CC1101_CMD_FLUSH_TX:
+            if (marc == CC1101_MARC_STATE_IDLE || marc == CC1101_MARC_STATE_TXFIFO_UNDERFLOW) {
+                tx.clear();
+                mTxLeft = 0;
+                if (marc == CC1101_MARC_STATE_TXFIFO_UNDERFLOW) {
+                    setMarc(CC1101_MARC_STATE_IDLE);
+                }
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+void ChipMock::goIdle()
+{
+    bool active = marc == CC1101_MARC_STATE_RX || marc == CC1101_MARC_STATE_TX || marc == CC1101_MARC_STATE_FSTXON;
+    setMarc(CC1101_MARC_STATE_IDLE);
+    if (!active) {
+        return;
+    }
+
+    uint8_t autoCal = regs[CC1101_REG_MCSM0] & 0x30;
+    if (autoCal == CC1101_FS_AUTOCAL_RXTX_TO_IDLE ||
+        (autoCal == CC1101_FS_AUTOCAL_RXTX_TO_IDLE_4TH && ++mIdleTransitions % 4 == 0)) {
+        setMarc(CC1101_MARC_STATE_STARTCAL);
+        mPending = CC1101_MARC_STATE_IDLE;
+        mPendingUntil = now + CalibrationUs;
+        mPendingCalibration = true;
+    }
+}
+
+void ChipMock::calibrate()
+{
+    // The results depend on the frequency; FSCAL2[5] (VCO_CORE_H_EN) and FSCAL3[5:4]
+    // (CHP_CURR_CAL_EN) are settings and are kept, the charge pump current is only
+    // calibrated when CHP_CURR_CAL_EN is set.
+    ++calibrations;
+    uint32_t frf = (static_cast<uint32_t>(regs[CC1101_REG_FREQ2]) << 16) | (regs[CC1101_REG_FREQ1] << 8) |
+                   regs[CC1101_REG_FREQ0];
+    uint32_t v = frf + regs[CC1101_REG_CHANNR] * 977u;
+    if (regs[CC1101_REG_FSCAL3] & 0x30) {
+        regs[CC1101_REG_FSCAL3] = (regs[CC1101_REG_FSCAL3] & 0xf0) | ((v >> 3) & 0x0f);
+    }
+    regs[CC1101_REG_FSCAL2] = (regs[CC1101_REG_FSCAL2] & 0xe0) | ((v >> 7) & 0x1f);
+    regs[CC1101_REG_FSCAL1] = (v >> 12) & 0x3f;
+}
+
+// Arduino core on top of the mock
+
+unsigned long millis()
+{
+    return chip.now / 1000;
+}
+
+unsigned long micros()
+{
+    return chip.now;
+}
+
+void delay(unsigned long ms)
+{
+    chip.advance(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    chip.advance(us);
+}
+
+void yield() {}
+
+void pinMode(uint8_t, uint8_t) {}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+    if (pin == ChipMock::CsPin) {
+        chip.select(value == LOW);
+    }
+}
+
+int digitalRead(uint8_t pin)
+{
+    switch (pin) {
+        case ChipMock::Gdo0Pin:
+            return chip.gdo0() ? HIGH : LOW;
+        case ChipMock::Gdo2Pin:
+            return chip.gdo2() ? HIGH : LOW;
+        default:
+            // MISO low: the chip is ready
+            return LOW;
+    }
+}
+
+void attachInterrupt(uint8_t, void (*)(), int) {}
+
+void detachInterrupt(uint8_t) {}
+
+void noInterrupts() {}
+
+void interrupts() {}
+
+uint8_t SPIClass::transfer(uint8_t data)
+{
+    return chip.transfer(data);
+}
+
+void SPIClass::transferBytes(const uint8_t *out, uint8_t *in, uint32_t size)
+{
+    ++chip.blocks;
+    for (uint32_t i = 0; i < size; ++i) {
+        uint8_t value = chip.transfer(out != nullptr ? out[i] : 0xff);
+        if (in != nullptr) {
+            in[i] = value;
+        }
+    }
+}
+
+size_t HardwareSerial::print(unsigned long n, int base)
+{
+    char buf[24];
+    snprintf(buf, sizeof(buf), base == HEX ? "%lX" : "%lu", n);
+    return print(buf);
+}
+
+size_t HardwareSerial::print(long n, int base)
+{
+    if (base == HEX) {
+        return print(static_cast<unsigned long>(n), base);
+    }
+    char buf[24];
+    snprintf(buf, sizeof(buf), "%ld", n);
+    return print(buf);
+}
+
+size_t HardwareSerial::print(double n, int digits)
+{
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%.*f", digits, n);
+    return print(buf);
+}
@@ -0,0 +1,104 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+#ifndef CCSNIFFER_CHIPMOCK_H
+#define CCSNIFFER_CHIPMOCK_H
+
+#include <stdint.h>
+#include <deque>
+#include <vector>
+#include "cc1101consts.h"
+
+// SPI level model of the CC1101 for the host tests, wired to CS 10, GDO0 3 and GDO2 2.
+//
+// It keeps the registers and the FIFOs, decodes the header byte of each transaction, answers with
+// the status byte and follows the main state machine far enough for the driver: strobes, automatic
+// and manual calibration, settling times, RXOFF after a packet, FIFO overflow and underflow.
+// GDO0 and GDO2 follow IOCFG0 and IOCFG2 for the signals the driver uses.
+//
+// Time only moves with delay(), delayMicroseconds() and advance(), plus 1 us per SPI byte.
+struct ChipMock {
+    static const uint8_t CsPin = 10;
+    static const uint8_t Gdo0Pin = 3;
+    static const uint8_t Gdo2Pin = 2;
+
+    // Datasheet timings at 26 MHz: manual calibration, IDLE to RX with and without calibration
+    static const unsigned long CalibrationUs = 718;
+    static const unsigned long SettlingUs = 88;
+    static const unsigned long CalibratedSettlingUs = 809;
+
+    uint8_t regs[CC1101_REG_TEST0 + 1];
+    uint8_t patable[8];
+    std::deque<uint8_t> rx;
+    std::deque<uint8_t> tx;
+    uint8_t marc;
+    uint8_t rssi;
+    // a sync word is being received or sent (GDO0 signal 0x06)
+    bool sync;
+
+    unsigned long now;
+    // SPI transactions, bytes, block transfers (ESP32 path) and strobes
+    long transactions;
+    long bytes;
+    long blocks;
+    long strobes;
+    long calibrations;
+    // time spent outside RX since reset, and how many times RX was left
+    unsigned long blindUs;
+    long rxExits;
+
+    ChipMock() { reset(); }
+
+    void reset();
+    void advance(unsigned long us);
+
+    // Over the air: the sync line goes up, then the bytes of the packet arrive as the packet handler
+    // writes them to the FIFO (length byte, payload, and RSSI and LQI if appended). Nothing arrives
+    // outside RX.
+    void startPacket();
+    void receiveBytes(const uint8_t *data, size_t len);
+    // End of packet: the sync line drops and the chip goes where MCSM1 RXOFF says. A discarded
+    // packet (address or length check) is taken out of the FIFO again.
+    void endPacket(bool discarded = false);
+    // Sends one byte from the TX FIFO; false at the end of the packet, on underflow or outside TX
+    bool transmitByte();
+
+    bool gdo0() { return signal(regs[CC1101_REG_IOCFG0]); }
+    bool gdo2() { return signal(regs[CC1101_REG_IOCFG2]); }
+    uint8_t rxThreshold() const { return 4 * ((regs[CC1101_REG_FIFOTHR] & 0x0f) + 1); }
+    uint8_t txThreshold() const { return 65 - rxThreshold(); }
+    bool receiving() { update(); return marc == CC1101_MARC_STATE_RX; }
+
+    // SPI
+    void select(bool selected);
+    uint8_t transfer(uint8_t data);
+
+private:
+    bool signal(uint8_t config);
+    uint8_t status(bool write);
+    uint8_t readStatusRegister(uint8_t reg);
+    void strobe(uint8_t command);
+    void calibrate();
+    void enterRx();
+    void goIdle();
+    void setMarc(uint8_t state);
+    void setMarc(uint8_t state, unsigned long at);
+    void update();
+
+    // state reached once the current one is over, if pendingUntil is set
+    uint8_t mPending;
+    unsigned long mPendingUntil;
+    bool mPendingCalibration;
+    uint8_t mIdleTransitions;
+    unsigned long mRxLeft;
+    bool mSelected;
+    uint8_t mHeader;
+    uint8_t mCount;
+    size_t mPacketStart;
+    uint16_t mTxLeft;
+};
+
+extern ChipMock chip;
+
+#endif //CCSNIFFER_CHIPMOCK_H
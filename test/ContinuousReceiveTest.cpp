@@ -0,0 +1,193 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+// Continuous receive: packets back to back without leaving RX, an end of packet interrupt served
+// after the next packet started, the sequence numbers then, and the blind time of a recalibration.
+
+#include "RadioTest.h"
+#include "Timestamp.h"
+
+static void backToBack()
+{
+    startReceiver();
+    long calibrations = chip.calibrations;
+    unsigned long blind = chip.blindUs;
+    std::vector<Bytes> sent;
+    for (int i = 0; i < 100; ++i) {
+        sent.push_back(packet(5 + i % 60, i));
+        receivePacket(sent.back(), 160);
+    }
+    CHECK(received == sent);
+    CHECK(failed.empty());
+    // never off the air, and never calibrated either
+    CHECK_EQUAL(chip.blindUs - blind, 0);
+    CHECK_EQUAL(chip.calibrations, calibrations);
+    CHECK(chip.receiving());
+}
+
+static void lateEndOfPacket()
+{
+    // A is drained on the threshold but its end of packet interrupt is only served once the
+    // threshold interrupt has already completed A and started on B
+    startReceiver();
+    Bytes a = packet(40, 1);
+    Bytes b = packet(50, 100);
+    chip.startPacket();
+    feed(a.data(), a.size());
+    chip.endPacket();
+    chip.startPacket();
+    feed(b.data(), 25);
+    CHECK_EQUAL(received.size(), 1);
+    radio.endReceive();
+
+    feed(&b[25], b.size() - 25);
+    endPacket();
+    CHECK_EQUAL(received.size(), 2);
+    CHECK(received.size() == 2 && received[0] == a && received[1] == b);
+    CHECK(failed.empty());
+
+    // and the parser is still in step
+    Bytes c = packet(3, 7);
+    receivePacket(c);
+    CHECK(!received.empty() && received.back() == c);
+    CHECK(failed.empty());
+}
+
+// Sequence numbers as main.cpp gives them: latched on the sync interrupt, taken by the allocator
+static SyncStamps<4> stamps;
+static uint16_t syncs = 0;
+static std::vector<uint16_t> sequences;
+
+static uint8_t *stampedAllocate(uint16_t len)
+{
+    SyncStamps<4>::Stamp stamp;
+    sequences.push_back(stamps.take(stamp) ? stamp.sequence : 0);
+    return allocatePacket(len);
+}
+
+static void stampedComplete(const ReadStatus &status)
+{
+    if (status.errc == ReadErrCode::Overflow) {
+        stamps.keep(0);
+    } else if (status.len == 0) {
+        stamps.drop();
+    }
+    completePacket(status);
+}
+
+// The GDO0 interrupt, served once for all the edges since the last time
+static void syncInterrupt()
+{
+    if (radio.syncDetected()) {
+        stamps.latch(++syncs, Timestamp());
+        return;
+    }
+    radio.endReceive();
+    stamps.keep(radio.syncDetected() ? 1 : 0);
+}
+
+static void stampedPacket(const Bytes &bytes)
+{
+    chip.startPacket();
+    syncInterrupt();
+    feed(bytes.data(), bytes.size());
+    chip.endPacket();
+    syncInterrupt();
+}
+
+static void lateSequence()
+{
+    startReceiver();
+    radio.setReceiveHandlers(stampedAllocate, stampedComplete);
+
+    // A is below the FIFO threshold and its end of packet interrupt is only served after the sync
+    // word of B: the length byte of A is read after B took its sequence number
+    Bytes a = packet(10, 1);
+    Bytes b = packet(20, 50);
+    chip.startPacket();
+    syncInterrupt();
+    feed(a.data(), a.size());
+    chip.endPacket();
+    chip.startPacket();
+    syncInterrupt();
+    feed(b.data(), b.size());
+    chip.endPacket();
+    syncInterrupt();
+    CHECK(received.size() == 2 && received[0] == a && received[1] == b);
+
+    // a sync word without a packet keeps its number, the next packet gets its own
+    chip.startPacket();
+    syncInterrupt();
+    chip.endPacket();
+    syncInterrupt();
+    stampedPacket(packet(5, 9));
+
+    CHECK(sequences == std::vector<uint16_t>({1, 2, 4}));
+    CHECK(failed.size() == 1 && failed[0] == ReadErrCode::NoData);
+    CHECK_EQUAL(stamps.size(), 0);
+
+    // stamps left over by a flushed FIFO are gone by the next quiet end of packet
+    stamps.latch(++syncs, Timestamp());
+    stamps.latch(++syncs, Timestamp());
+    chip.startPacket();
+    syncInterrupt();
+    chip.endPacket();
+    syncInterrupt();
+    stampedPacket(packet(5, 10));
+    CHECK_EQUAL(sequences.back(), syncs);
+}
+
+static void recalibration()
+{
+    startReceiver();
+    long calibrations = chip.calibrations;
+    unsigned long blind = chip.blindUs;
+    long transactions = chip.transactions;
+    CHECK(radio.recalibrate());
+    long spi = chip.transactions - transactions;
+    chip.advance(2000);
+    CHECK(chip.receiving());
+    CHECK_EQUAL(chip.calibrations, calibrations + 1);
+    unsigned long recalibrationUs = chip.blindUs - blind;
+    printf("recalibration: %lu us off the air, %ld SPI transactions\n", recalibrationUs, spi);
+    // IDLE to RX with calibration, plus the strobes
+    CHECK(recalibrationUs >= ChipMock::CalibratedSettlingUs && recalibrationUs < ChipMock::CalibratedSettlingUs + 50);
+
+    // a packet arriving meanwhile is lost, the next one is fine
+    CHECK(radio.recalibrate());
+    Bytes a = packet(10, 1);
+    receivePacket(a);
+    chip.advance(2000);
+    receivePacket(a);
+    CHECK_EQUAL(received.size(), 1);
+    CHECK(failed.empty());
+
+    // never in the middle of a packet
+    calibrations = chip.calibrations;
+    chip.startPacket();
+    feed(a.data(), 5);
+    CHECK(!radio.recalibrate());
+    feed(&a[5], a.size() - 5);
+    endPacket();
+    CHECK_EQUAL(received.size(), 2);
+    CHECK_EQUAL(chip.calibrations, calibrations);
+
+    // nothing to do with fast hopping or without continuous receive
+    radio.setFastHopping(true);
+    radio.receive();
+    CHECK(!radio.recalibrate());
+    radio.setFastHopping(false);
+    radio.setContinuousReceive(false);
+    radio.receive();
+    CHECK(!radio.recalibrate());
+}
+
+int main()
+{
+    backToBack();
+    lateEndOfPacket();
+    lateSequence();
+    recalibration();
+    return checkResult();
+}
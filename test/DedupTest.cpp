@@ -0,0 +1,206 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+// Duplicate window: copies within the window are folded into the waiting packet, and a replay of
+// repeated frames goes out once per frame with every copy counted, in fewer serial bytes.
+
+#include <string.h>
+#include <algorithm>
+#include "Check.h"
+#include "DedupTable.h"
+#include "PacketOutput.h"
+#include "PacketQueue.h"
+
+static PacketsQueue<128, 16> queue;
+
+static Packet *queuePacket(const uint8_t *payload, uint8_t len, uint32_t us)
+{
+    Packet *packet = queue.reserve(len);
+    CHECK(packet != nullptr);
+    packet->rawCopyFrom(payload, len);
+    Timestamp t;
+    t.low = us;
+    packet->setTimestamp(t);
+    queue.commit();
+    return packet;
+}
+
+static void window()
+{
+    DedupTable dedup;
+    const uint8_t a[] = {1, 2, 3, 4};
+    const uint8_t b[] = {1, 2, 3, 5};
+    uint16_t hash = DedupTable::hash(a, sizeof(a));
+
+    // off by default
+    Packet *packet = queuePacket(a, sizeof(a), 0);
+    dedup.add(hash, packet);
+    CHECK(!dedup.fold(hash, a, sizeof(a), PacketOK, 0x20, 1000));
+    CHECK(!dedup.held(packet, 1000));
+
+    CHECK(dedup.setWindow(100));
+    CHECK_EQUAL(dedup.window(), 100);
+    dedup.add(hash, packet);
+    CHECK(dedup.held(packet, 99999));
+    CHECK(!dedup.held(packet, 100000));
+
+    CHECK(dedup.fold(hash, a, sizeof(a), PacketOK, 0x20, 50000));
+    CHECK(dedup.fold(hash, a, sizeof(a), PacketOK, 0x10, 99999));
+    CHECK_EQUAL(packet->getCopies(), 3);
+    CHECK_EQUAL(packet->getBestRssi(), 0x20);
+    CHECK_EQUAL(dedup.folded(), 2);
+
+    // past the window, another CRC status, another payload with the same hash, shorter
+    CHECK(!dedup.fold(hash, a, sizeof(a), PacketOK, 0x20, 100000));
+    CHECK(!dedup.fold(hash, a, sizeof(a), CRCError, 0x20, 50000));
+    CHECK(!dedup.fold(hash, b, sizeof(b), PacketOK, 0x20, 50000));
+    CHECK(!dedup.fold(hash, a, sizeof(a) - 1, PacketOK, 0x20, 50000));
+    CHECK_EQUAL(packet->getCopies(), 3);
+
+    // written out
+    dedup.forget(packet);
+    CHECK(!dedup.fold(hash, a, sizeof(a), PacketOK, 0x20, 50000));
+    queue.release();
+    CHECK(queue.empty());
+}
+
+static void fullTable()
+{
+    // one packet more than the entries: the oldest is no longer matched
+    DedupTable dedup;
+    dedup.setWindow(1000);
+    uint8_t payload[DEDUP_ENTRIES + 1];
+    for (uint8_t i = 0; i <= DEDUP_ENTRIES; ++i) {
+        payload[i] = i;
+        dedup.add(DedupTable::hash(&payload[i], 1), queuePacket(&payload[i], 1, i * 1000));
+    }
+    for (uint8_t i = 0; i <= DEDUP_ENTRIES; ++i) {
+        bool folded = dedup.fold(DedupTable::hash(&payload[i], 1), &payload[i], 1, PacketOK, 0, 100000);
+        CHECK_EQUAL(folded, i != 0);
+    }
+    while (!queue.empty()) {
+        queue.release();
+    }
+}
+
+static void replay()
+{
+    // 400 frames sent 1 to 3 times 25 ms apart, with a 100 ms window
+    DedupTable dedup;
+    dedup.setWindow(100);
+    uint32_t now = 0;
+    int sent = 0;
+    int lines = 0;
+    int copies = 0;
+    for (int frame = 0; frame < 400; ++frame) {
+        uint8_t payload[20];
+        for (uint8_t i = 0; i < sizeof(payload); ++i) {
+            payload[i] = frame * 7 + i;
+        }
+        uint16_t hash = DedupTable::hash(payload, sizeof(payload));
+        for (int copy = 0; copy <= frame % 3; ++copy) {
+            ++sent;
+            if (!dedup.fold(hash, payload, sizeof(payload), PacketOK, 0x30, now)) {
+                dedup.add(hash, queuePacket(payload, sizeof(payload), now));
+            }
+            now += 25000;
+
+            // the output side, as loop() does it
+            const Packet *head;
+            while ((head = queue.peek()) != nullptr && !dedup.held(head, now)) {
+                dedup.forget(head);
+                ++lines;
+                copies += head->getCopies();
+                queue.release();
+            }
+        }
+    }
+    now += 100000;
+    const Packet *head;
+    while ((head = queue.peek()) != nullptr) {
+        CHECK(!dedup.held(head, now));
+        dedup.forget(head);
+        ++lines;
+        copies += head->getCopies();
+        queue.release();
+    }
+    CHECK_EQUAL(lines, 400);
+    CHECK_EQUAL(copies, sent);
+    CHECK_EQUAL(dedup.folded(), sent - 400);
+}
+
+// The same replay written out as text lines by PacketOutput, as handleReceived() does it; returns
+// the serial bytes
+static size_t replayOutput(uint16_t windowMs)
+{
+    DedupTable dedup;
+    CHECK(dedup.setWindow(windowMs));
+    PacketOutput output;
+    Serial.output.clear();
+    uint32_t now = 0;
+    uint16_t sequence = 0;
+
+    auto writeOut = [&](uint32_t until) {
+        const Packet *head;
+        while ((head = queue.peek()) != nullptr && !dedup.held(head, until)) {
+            dedup.forget(head);
+            output.begin(head, false, false);
+            uint8_t line[32];
+            while (!output.done()) {
+                Serial.write(line, output.read(line, sizeof(line)));
+            }
+            queue.release();
+        }
+    };
+
+    for (int frame = 0; frame < 400; ++frame) {
+        uint8_t payload[20];
+        for (uint8_t i = 0; i < sizeof(payload); ++i) {
+            payload[i] = frame * 7 + i;
+        }
+        uint16_t hash = DedupTable::hash(payload, sizeof(payload));
+        for (int copy = 0; copy <= frame % 3; ++copy) {
+            uint8_t rssi = 0x30 + copy;
+            ++sequence;
+            if (!dedup.fold(hash, payload, sizeof(payload), PacketOK, rssi, now)) {
+                Packet *packet = queuePacket(payload, sizeof(payload), now);
+                packet->setSequence(sequence);
+                packet->setRssi(rssi);
+                dedup.add(hash, packet);
+            }
+            now += 25000;
+            writeOut(now);
+        }
+    }
+    writeOut(now + 100000);
+    CHECK(queue.empty());
+    return Serial.output.size();
+}
+
+static void savedBytes()
+{
+    size_t all = replayOutput(0);
+    long allLines = std::count(Serial.output.begin(), Serial.output.end(), '\n');
+    CHECK(Serial.output.find(",x") == std::string::npos);
+
+    size_t folded = replayOutput(100);
+    long foldedLines = std::count(Serial.output.begin(), Serial.output.end(), '\n');
+    CHECK(Serial.output.find(",x3:50") != std::string::npos);
+
+    printf("replay: %ld lines, %zu serial bytes without the window, %ld lines, %zu bytes with 100 ms\n",
+           allLines, all, foldedLines, folded);
+    // 799 copies of 400 frames: half the lines, the repeat counts take a few bytes back
+    CHECK_EQUAL(allLines, 799);
+    CHECK_EQUAL(foldedLines, 400);
+    CHECK(100 * folded < 55 * all);
+}
+
+int main()
+{
+    window();
+    fullTable();
+    replay();
+    savedBytes();
+    return checkResult();
+}
@@ -0,0 +1,306 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+// Draining the RX FIFO from the interrupts: packets shorter than the threshold are read once on the
+// end of packet edge, without polling RXBYTES; longer ones are streamed out on the threshold of the
+// profile, never emptying the FIFO while the packet is still arriving, from 38.4 to 250 kbps with
+// the interrupts served late. The interrupt time per packet is compared with the RXBYTES polling
+// of the old driver, on the mock clock (1 us a SPI byte).
+
+#include "RadioTest.h"
+
+static void shortPackets()
+{
+    startReceiver();
+    for (uint8_t len = 0; len + 3 < chip.rxThreshold(); ++len) {
+        Bytes bytes = packet(len, len);
+        long transactions = chip.transactions;
+        chip.startPacket();
+        feed(bytes.data(), bytes.size(), 200);
+        // nothing to do until the end of the packet
+        CHECK_EQUAL(chip.transactions, transactions);
+        endPacket();
+        // The length byte, then the rest of the packet. The status byte of that burst counts the
+        // bytes left in the FIFO up to 15, past that RXBYTES tells if another packet follows.
+        CHECK_EQUAL(chip.transactions - transactions, len + 2 < 15 ? 2 : 3);
+        CHECK(!received.empty() && received.back() == bytes);
+    }
+    CHECK(failed.empty());
+    CHECK(chip.rx.empty());
+}
+
+static void emptyEndOfPacket()
+{
+    startReceiver();
+    chip.startPacket();
+    endPacket();
+    CHECK_EQUAL(failed.size(), 1);
+    CHECK(failed.size() == 1 && failed[0] == ReadErrCode::NoData);
+
+    Bytes bytes = packet(10, 1);
+    receivePacket(bytes);
+    CHECK_EQUAL(received.size(), 1);
+    CHECK(received.size() == 1 && received[0] == bytes);
+}
+
+static void singleShot()
+{
+    // without continuous receive the chip goes to IDLE and the driver back to RX
+    startReceiver();
+    radio.setContinuousReceive(false);
+    radio.receive();
+    chip.advance(1000);
+    for (int i = 0; i < 3; ++i) {
+        Bytes bytes = packet(20, i);
+        receivePacket(bytes);
+        CHECK(!received.empty() && received.back() == bytes);
+        chip.advance(1000);
+        CHECK(chip.receiving());
+    }
+    CHECK_EQUAL(received.size(), 3);
+    CHECK(failed.empty());
+}
+
+// Feeds the packet with the threshold interrupt, checking that a drain leaves a byte in the FIFO
+static void streamPacket(const Bytes &bytes, unsigned long byteUs)
+{
+    chip.startPacket();
+    size_t emptied = 0;
+    for (size_t i = 0; i < bytes.size(); ++i) {
+        feed(&bytes[i], 1, byteUs);
+        if (chip.rx.empty() && emptied == 0) {
+            emptied = i + 1;
+        }
+    }
+    endPacket();
+    if (emptied != 0) {
+        fprintf(stderr, "%zu bytes packet: FIFO emptied after byte %zu\n", bytes.size(), emptied);
+        ++checkFailures;
+    }
+}
+
+static void longPackets()
+{
+    // RX thresholds of 4, 32 and 48 bytes
+    const uint8_t thresholds[] = {CC1101_FIFO_THR_TX_61_RX_4, CC1101_FIFO_THR_TX_33_RX_32, 0b1011};
+    for (uint8_t thr : thresholds) {
+        const RadioProfile profile = RadioProfile::defaults().set(CC1101_REG_FIFOTHR, thr, 3, 0);
+        startReceiver(profile);
+        std::vector<Bytes> sent;
+        for (int len : {10, 61, 62, 120, 200, 255}) {
+            sent.push_back(packet(len, len));
+            streamPacket(sent.back(), 20);
+        }
+        CHECK(received == sent);
+        CHECK(failed.empty());
+        CHECK(chip.rx.empty());
+    }
+}
+
+// The packet arriving every byteUs on the mock clock, each interrupt served latencyUs after its
+// edge; the bytes go on arriving meanwhile and during the SPI bursts of the drain.
+static void streamLate(const Bytes &bytes, unsigned long byteUs, unsigned long latencyUs)
+{
+    chip.startPacket();
+    unsigned long next = chip.now;
+    bool pending = false;
+    unsigned long serveAt = 0;
+    size_t i = 0;
+    while (i < bytes.size()) {
+        if (pending && chip.now >= serveAt) {
+            pending = false;
+            radio.drainFifo();
+            continue;
+        }
+        unsigned long at = pending && serveAt < next ? serveAt : next;
+        if (at > chip.now) {
+            chip.advance(at - chip.now);
+        }
+        while (i < bytes.size() && next <= chip.now) {
+            bool above = chip.gdo2();
+            chip.receiveBytes(&bytes[i++], 1);
+            next += byteUs;
+            if (!above && chip.gdo2() && !pending) {
+                pending = true;
+                serveAt = chip.now + latencyUs;
+            }
+        }
+    }
+
+    bool sync = chip.gdo0();
+    chip.endPacket();
+    chip.advance(latencyUs);
+    if (pending) {
+        radio.drainFifo();
+    }
+    if (sync && !chip.gdo0()) {
+        radio.endReceive();
+    }
+}
+
+static void bitrates()
+{
+    // 38.4, 100 and 250 kbps, interrupts 200 us late: the 32 bytes above the threshold of the
+    // default profile last 1 ms at 250 kbps
+    for (unsigned long byteUs : {208, 80, 32}) {
+        startReceiver();
+        std::vector<Bytes> sent;
+        for (int len : {20, 61, 100, 255}) {
+            sent.push_back(packet(len, len));
+            streamLate(sent.back(), byteUs, 200);
+        }
+        CHECK(received == sent);
+        CHECK(failed.empty());
+        CHECK(chip.rx.empty());
+        CHECK(chip.receiving());
+    }
+
+    // with the interrupt over a FIFO late the chip overflows, and it is reported
+    startReceiver();
+    streamLate(packet(255, 1), 32, 1200);
+    CHECK(received.empty());
+    CHECK(failed.size() == 1 && failed[0] == ReadErrCode::Overflow);
+}
+
+// Mock time spent in the interrupts of the driver for a packet arriving every byteUs
+static unsigned long interruptUs(const Bytes &bytes, unsigned long byteUs)
+{
+    unsigned long busy = 0;
+    chip.startPacket();
+    for (size_t i = 0; i < bytes.size(); ++i) {
+        bool above = chip.gdo2();
+        chip.receiveBytes(&bytes[i], 1);
+        if (!above && chip.gdo2()) {
+            unsigned long start = chip.now;
+            radio.drainFifo();
+            busy += chip.now - start;
+        }
+        chip.advance(byteUs);
+    }
+    bool sync = chip.gdo0();
+    chip.endPacket();
+    if (sync && !chip.gdo0()) {
+        unsigned long start = chip.now;
+        radio.endReceive();
+        busy += chip.now - start;
+    }
+    return busy;
+}
+
+// The interrupt of the old driver, on the sync word: up to 100 RXBYTES polls for the first byte,
+// then bursts of what RXBYTES counted until it read 0. The packet goes on arriving meanwhile;
+// read counts the bytes it got out of the FIFO.
+static unsigned long pollingInterruptUs(const Bytes &bytes, unsigned long byteUs, bool &timeout, size_t &read)
+{
+    chip.startPacket();
+    unsigned long start = chip.now;
+    size_t arrived = 0;
+    auto deliver = [&]() {
+        while (arrived < bytes.size() && start + (arrived + 1) * byteUs <= chip.now) {
+            chip.receiveBytes(&bytes[arrived++], 1);
+        }
+    };
+
+    timeout = true;
+    read = 0;
+    for (int retries = 0; retries < 100; ++retries) {
+        deliver();
+        if (radio.SPIgetRegValue(CC1101_REG_RXBYTES, 6, 0) > 0) {
+            timeout = false;
+            break;
+        }
+    }
+    if (!timeout) {
+        uint8_t buffer[CC1101_FIFO_SIZE];
+        deliver();
+        uint8_t count = radio.SPIgetRegValue(CC1101_REG_RXBYTES, 6, 0);
+        while (count > 0) {
+            radio.SPIreadRegisterBurst(CC1101_REG_FIFO, count, buffer);
+            read += count;
+            deliver();
+            count = radio.SPIgetRegValue(CC1101_REG_RXBYTES, 6, 0);
+        }
+    }
+    unsigned long busy = chip.now - start;
+
+    // the old driver went back to RX, flushing the rest
+    chip.advance(bytes.size() * byteUs);
+    deliver();
+    chip.endPacket();
+    radio.receive();
+    chip.advance(1000);
+    return busy;
+}
+
+static void interruptTime()
+{
+    // at 38.4 and 100 kbps, a short packet and one filling the FIFO
+    for (unsigned long byteUs : {208, 80}) {
+        for (uint8_t len : {20, 60}) {
+            Bytes bytes = packet(len, len);
+            startReceiver();
+            bool timeout;
+            size_t read;
+            unsigned long before = pollingInterruptUs(bytes, byteUs, timeout, read);
+            unsigned long after = interruptUs(bytes, byteUs);
+            printf("%lu us a byte, %u bytes packet: polling RXBYTES %lu us in the interrupt for %zu bytes%s, "
+                   "now %lu us for all %zu\n", byteUs, len, before, read, timeout ? " (timeout)" : "",
+                   after, bytes.size());
+            // 100 polls don't last a byte at 38.4 kbps: the timeouts seen in the field. Faster, the
+            // first bytes were read and the rest of the packet flushed.
+            CHECK_EQUAL(timeout, byteUs > 200);
+            CHECK(read < bytes.size());
+            CHECK(!received.empty() && received.back() == bytes);
+            CHECK(after < before);
+        }
+    }
+}
+
+static void lateThresholdInterrupt()
+{
+    // served late, with the FIFO already well above a threshold of 4 bytes: a burst leaves GDO2
+    // high and there will be no new edge, the drain goes on until it drops
+    startReceiver(RadioProfile::defaults().set(CC1101_REG_FIFOTHR, CC1101_FIFO_THR_TX_61_RX_4, 3, 0));
+    Bytes bytes = packet(200, 3);
+    chip.startPacket();
+    chip.receiveBytes(bytes.data(), 60);
+    radio.drainFifo();
+    CHECK(chip.rx.size() < chip.rxThreshold());
+    CHECK(!chip.rx.empty());
+    feed(&bytes[60], bytes.size() - 60);
+    endPacket();
+    CHECK_EQUAL(received.size(), 1);
+    CHECK(received.size() == 1 && received[0] == bytes);
+    CHECK(failed.empty());
+}
+
+static void overflow()
+{
+    startReceiver();
+    Bytes bytes = packet(200, 3);
+    chip.startPacket();
+    chip.receiveBytes(bytes.data(), 70);
+    radio.drainFifo();
+    CHECK_EQUAL(failed.size(), 1);
+    CHECK(failed.size() == 1 && failed[0] == ReadErrCode::Overflow);
+    chip.advance(1000);
+    CHECK(chip.receiving());
+
+    Bytes next = packet(100, 4);
+    receivePacket(next);
+    CHECK(!received.empty() && received.back() == next);
+}
+
+int main()
+{
+    shortPackets();
+    emptyEndOfPacket();
+    singleShot();
+    longPackets();
+    bitrates();
+    interruptTime();
+    lateThresholdInterrupt();
+    overflow();
+    return checkResult();
+}
@@ -0,0 +1,161 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+// Binary frames: FrameEncoder against a reference COBS encoder, and back through readFrame(),
+// with runs of zeros and non zero blocks around the 254 bytes limit.
+
+#include <vector>
+#include "Check.h"
+#include "Frame.h"
+
+typedef std::vector<uint8_t> Bytes;
+
+// Textbook COBS of data, with the delimiter: a block of 254 non zero bytes has no zero after it
+static Bytes cobs(const Bytes &data)
+{
+    Bytes out;
+    size_t i = 0;
+    while (true) {
+        size_t run = 0;
+        while (i + run < data.size() && run < 254 && data[i + run] != 0) {
+            ++run;
+        }
+        out.push_back(run + 1);
+        out.insert(out.end(), data.begin() + i, data.begin() + i + run);
+        i += run;
+        if (i == data.size()) {
+            break;
+        }
+        if (run < 254) {
+            ++i;
+        }
+    }
+    out.push_back(0);
+    return out;
+}
+
+// Encodes data as a frame, split in segments at the given points and read in chunks of chunk bytes
+static Bytes encode(const Bytes &data, const std::vector<size_t> &splits, uint16_t chunk)
+{
+    FrameSegment segments[FrameMaxSegments];
+    uint8_t count = 0;
+    size_t start = 0;
+    for (size_t split : splits) {
+        segments[count++] = FrameSegment{data.data() + start, static_cast<uint16_t>(split - start)};
+        start = split;
+    }
+    segments[count++] = FrameSegment{data.data() + start, static_cast<uint16_t>(data.size() - start)};
+
+    FrameEncoder encoder;
+    encoder.begin(segments, count);
+    Bytes out;
+    uint8_t buffer[300];
+    while (!encoder.done()) {
+        uint16_t n = encoder.read(buffer, chunk);
+        CHECK(n > 0);
+        out.insert(out.end(), buffer, buffer + n);
+    }
+    return out;
+}
+
+static Bytes withCrc(const Bytes &data)
+{
+    Bytes out = data;
+    uint16_t crc = frameCrc(0xffff, data.data(), data.size());
+    out.push_back(crc & 0xff);
+    out.push_back(crc >> 8);
+    return out;
+}
+
+static void roundTrip(const char *name, const Bytes &data)
+{
+    Bytes expected = cobs(withCrc(data));
+    for (uint16_t chunk : {1, 7, 16, 300}) {
+        Bytes single = encode(data, {}, chunk);
+        if (single != expected) {
+            fprintf(stderr, "%s: %zu bytes in chunks of %u differ from the reference\n", name, data.size(), chunk);
+            ++checkFailures;
+        }
+    }
+    if (data.size() >= 3) {
+        CHECK(encode(data, {1, data.size() / 2, data.size() - 1}, 16) == expected);
+    }
+
+    Bytes written;
+    FrameSegment segment{data.data(), static_cast<uint16_t>(data.size())};
+    writeFrame(&segment, 1, [&written](uint8_t b) { written.push_back(b); });
+    CHECK(written == expected);
+
+    // only the delimiter is zero
+    for (size_t i = 0; i + 1 < expected.size(); ++i) {
+        CHECK(expected[i] != 0);
+    }
+    CHECK_EQUAL(expected.back(), 0);
+
+    Bytes decoded(data.size() + FrameCrcSize);
+    int n = readFrame(expected.data(), expected.size() - 1, decoded.data(), decoded.size());
+    CHECK_EQUAL(n, data.size());
+    decoded.resize(data.size());
+    if (decoded != data) {
+        fprintf(stderr, "%s: %zu bytes do not decode back\n", name, data.size());
+        ++checkFailures;
+    }
+
+    // a flipped bit fails the CRC or the framing
+    for (size_t i = 0; i + 1 < expected.size(); i += 5) {
+        Bytes broken = expected;
+        broken[i] ^= 0x10;
+        Bytes out(data.size() + 16);
+        CHECK_EQUAL(readFrame(broken.data(), broken.size() - 1, out.data(), out.size()), -1);
+    }
+}
+
+static Bytes fill(size_t len, uint8_t value)
+{
+    return Bytes(len, value);
+}
+
+int main()
+{
+    // CRC-16/CCITT-FALSE check value
+    const char check[] = "123456789";
+    CHECK_EQUAL(frameCrc(0xffff, reinterpret_cast<const uint8_t *>(check), 9), 0x29b1);
+
+    roundTrip("type only", Bytes{static_cast<uint8_t>(FrameType::Status)});
+    for (size_t len : {1, 2, 3, 254, 255, 600}) {
+        roundTrip("zeros", fill(len, 0));
+    }
+    // non zero runs at and around the 254 bytes of a block, crc included
+    for (size_t len : {251, 252, 253, 254, 255, 256, 507, 508, 509}) {
+        roundTrip("ones", fill(len, 0xff));
+    }
+    Bytes mixed;
+    for (size_t run : {0, 1, 253, 254, 255, 3}) {
+        Bytes ones = fill(run, 0x5a);
+        mixed.insert(mixed.end(), ones.begin(), ones.end());
+        mixed.push_back(0);
+        mixed.push_back(0);
+    }
+    roundTrip("mixed", mixed);
+
+    uint32_t seed = 7;
+    for (int i = 0; i < 200; ++i) {
+        Bytes data(i * 3 + 1);
+        for (uint8_t &b : data) {
+            seed = seed * 1103515245 + 12345;
+            b = (seed >> 16) % 4 == 0 ? 0 : seed >> 8;
+        }
+        roundTrip("random", data);
+    }
+
+    // truncated frames and a zero inside are rejected
+    Bytes frame = encode(fill(20, 3), {}, 300);
+    Bytes out(64);
+    CHECK_EQUAL(readFrame(frame.data(), frame.size() - 3, out.data(), out.size()), -1);
+    frame[4] = 0;
+    CHECK_EQUAL(readFrame(frame.data(), frame.size() - 1, out.data(), out.size()), -1);
+    CHECK_EQUAL(readFrame(frame.data(), 0, out.data(), out.size()), -1);
+
+    return checkResult();
+}
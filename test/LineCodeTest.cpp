@@ -0,0 +1,185 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+// Manchester and 3-of-6 decoding against reference encoders, with invalid symbols in every position.
+
+#include <algorithm>
+#include <vector>
+#include "Check.h"
+#include "LineCode.h"
+
+typedef std::vector<uint8_t> Bytes;
+
+// 1 as 10, 0 as 01, most significant bit first
+static Bytes manchester(const Bytes &data)
+{
+    Bytes out;
+    for (uint8_t b : data) {
+        uint16_t chips = 0;
+        for (int bit = 7; bit >= 0; --bit) {
+            chips = (chips << 2) | ((b >> bit) & 1 ? 0b10 : 0b01);
+        }
+        out.push_back(chips >> 8);
+        out.push_back(chips & 0xff);
+    }
+    return out;
+}
+
+// EN 13757-4 table 10
+static const uint8_t threeOfSixCodes[16] = {
+        0x16, 0x0d, 0x0e, 0x0b, 0x1c, 0x19, 0x1a, 0x13, 0x2c, 0x25, 0x26, 0x23, 0x34, 0x31, 0x32, 0x29
+};
+
+// Code words of the nibbles packed most significant bit first, padded to a byte
+static Bytes threeOfSix(const std::vector<uint8_t> &words)
+{
+    Bytes out;
+    uint32_t bits = 0;
+    int count = 0;
+    for (uint8_t word : words) {
+        bits = (bits << 6) | word;
+        count += 6;
+        while (count >= 8) {
+            count -= 8;
+            out.push_back(bits >> count);
+        }
+    }
+    if (count > 0) {
+        out.push_back(bits << (8 - count));
+    }
+    return out;
+}
+
+static std::vector<uint8_t> threeOfSixWords(const Bytes &data)
+{
+    std::vector<uint8_t> words;
+    for (uint8_t b : data) {
+        words.push_back(threeOfSixCodes[b >> 4]);
+        words.push_back(threeOfSixCodes[b & 0x0f]);
+    }
+    return words;
+}
+
+static Bytes decode(LineCode code, const Bytes &in, bool &valid)
+{
+    Bytes out(in.size() + 1, 0xee);
+    uint8_t n = decodeLineCode(code, in.data(), in.size(), out.data(), valid);
+    out.resize(n);
+    return out;
+}
+
+static Bytes sample(size_t len)
+{
+    Bytes data(len);
+    for (size_t i = 0; i < len; ++i) {
+        data[i] = static_cast<uint8_t>(i * 37 + 11);
+    }
+    return data;
+}
+
+static void manchesterCases()
+{
+    bool valid;
+    Bytes all(256);
+    for (int i = 0; i < 256; ++i) {
+        all[i] = i;
+    }
+    for (size_t from = 0; from < 256; from += 64) {
+        Bytes data(all.begin() + from, all.begin() + from + 64);
+        CHECK(decode(LineCode::Manchester, manchester(data), valid) == data);
+        CHECK(valid);
+    }
+
+    // decoded in place, and a trailing odd byte is dropped
+    Bytes data = sample(40);
+    Bytes coded = manchester(data);
+    coded.push_back(0x55);
+    uint8_t n = decodeLineCode(LineCode::Manchester, coded.data(), coded.size(), coded.data(), valid);
+    CHECK(valid);
+    CHECK_EQUAL(n, data.size());
+    CHECK(std::equal(data.begin(), data.end(), coded.begin()));
+
+    // 00 and 11 are not chip pairs: decoding stops at the byte holding them
+    for (size_t pos = 0; pos < 2 * data.size(); ++pos) {
+        for (int pair = 0; pair < 4; ++pair) {
+            for (uint8_t chips : {0x00, 0xff}) {
+                uint8_t mask = 3 << (2 * pair);
+                Bytes broken = manchester(data);
+                broken[pos] = (broken[pos] & ~mask) | (chips & mask);
+                Bytes out = decode(LineCode::Manchester, broken, valid);
+                CHECK(!valid);
+                CHECK_EQUAL(out.size(), pos / 2);
+                CHECK(std::equal(out.begin(), out.end(), data.begin()));
+            }
+        }
+    }
+}
+
+static void threeOfSixCases()
+{
+    bool valid;
+    for (size_t len = 0; len <= 40; ++len) {
+        Bytes data = sample(len);
+        Bytes out = decode(LineCode::ThreeOfSix, threeOfSix(threeOfSixWords(data)), valid);
+        CHECK(valid);
+        if (out != data) {
+            fprintf(stderr, "3-of-6: %zu bytes do not decode back\n", len);
+            ++checkFailures;
+        }
+    }
+
+    // every nibble
+    Bytes nibbles;
+    for (int i = 0; i < 16; ++i) {
+        nibbles.push_back(i * 0x11);
+        nibbles.push_back(i);
+    }
+    CHECK(decode(LineCode::ThreeOfSix, threeOfSix(threeOfSixWords(nibbles)), valid) == nibbles);
+    CHECK(valid);
+
+    // a partial code word at the end is dropped
+    Bytes data = sample(9);
+    Bytes coded = threeOfSix(threeOfSixWords(data));
+    coded.pop_back();
+    Bytes out = decode(LineCode::ThreeOfSix, coded, valid);
+    CHECK(valid);
+    CHECK_EQUAL(out.size(), 8);
+
+    // the 48 invalid words in every position: decoding stops before the byte holding them
+    std::vector<uint8_t> invalid;
+    for (uint8_t word = 0; word < 64; ++word) {
+        bool used = false;
+        for (uint8_t code : threeOfSixCodes) {
+            used |= code == word;
+        }
+        if (!used) {
+            invalid.push_back(word);
+        }
+    }
+    CHECK_EQUAL(invalid.size(), 48);
+    data = sample(11);
+    for (size_t pos = 0; pos < 2 * data.size(); ++pos) {
+        for (uint8_t word : invalid) {
+            std::vector<uint8_t> words = threeOfSixWords(data);
+            words[pos] = word;
+            out = decode(LineCode::ThreeOfSix, threeOfSix(words), valid);
+            CHECK(!valid);
+            CHECK_EQUAL(out.size(), pos / 2);
+            CHECK(std::equal(out.begin(), out.end(), data.begin()));
+        }
+    }
+}
+
+int main()
+{
+    manchesterCases();
+    threeOfSixCases();
+
+    bool valid = false;
+    Bytes data = sample(30);
+    CHECK(decode(LineCode::None, data, valid) == data);
+    CHECK(valid);
+
+    return checkResult();
+}
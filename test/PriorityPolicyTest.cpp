@@ -0,0 +1,113 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+// Packet classes: rules, shares, and the admission that sheds the lower classes first when the
+// processed queue fills up.
+
+#include "Check.h"
+#include "PriorityPolicy.h"
+
+static void rules()
+{
+    PriorityPolicy policy;
+    CHECK(!policy.addRule(0, "prefix=44"));
+    CHECK(!policy.addRule(PRIORITY_CLASSES, "prefix=44"));
+    CHECK(policy.addRule(2, "prefix=44"));
+    CHECK(policy.addRule(1, "len=4-8"));
+    for (uint8_t r = 2; r < FILTER_MAX_RULES; ++r) {
+        CHECK(policy.addRule(1, "crc"));
+    }
+    CHECK(!policy.addRule(1, "crc"));
+
+    // the first rule that matches wins
+    const uint8_t meter[] = {0x44, 1, 2, 3, 4};
+    const uint8_t other[] = {0x45, 1, 2, 3, 4};
+    const uint8_t longer[] = {0x45, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+    CHECK_EQUAL(policy.classify(meter, sizeof(meter), 0, false), 2);
+    CHECK_EQUAL(policy.classify(other, sizeof(other), 0, false), 1);
+    CHECK_EQUAL(policy.classify(longer, sizeof(longer), 0, false), 0);
+}
+
+static void shares()
+{
+    PriorityPolicy policy;
+    CHECK(!policy.setShare(0, 10));
+    CHECK(policy.setShare(2, 60));
+    CHECK(!policy.setShare(1, 40));
+    CHECK(policy.setShare(1, 30));
+    // a class can be changed within the total
+    CHECK(policy.setShare(2, 50));
+    CHECK(policy.setShare(1, 40));
+
+    // every class keeps out of the room reserved above it
+    policy.setShare(2, 30);
+    policy.setShare(1, 10);
+    CHECK(policy.admit(0, 100, 500, 1000));
+    CHECK(!policy.admit(0, 101, 500, 1000));
+    CHECK(policy.admit(1, 100, 600, 1000));
+    CHECK(!policy.admit(1, 101, 600, 1000));
+    CHECK(policy.admit(2, 100, 900, 1000));
+    // a full queue still makes it wait, that is up to the caller
+    CHECK(policy.admit(2, 100, 1000, 1000));
+
+    // without shares everything is admitted
+    policy.clear();
+    CHECK(policy.admit(0, 100, 1000, 1000));
+}
+
+// Lost packets per class after a minute of chatter at 120 packets/s, plus 5/s of class 1 and 2/s of
+// class 2 arriving at random, with room for 16 packets and output for 40/s. A packet that is
+// admitted but finds the queue full is lost too, as it would be in the raw queue.
+static void overload(PriorityPolicy &policy, uint16_t sent[PRIORITY_CLASSES], uint16_t lost[PRIORITY_CLASSES])
+{
+    const uint16_t size = 32;
+    const uint16_t capacity = 16 * size;
+    // arrivals per 10000 ms
+    const uint16_t rate[PRIORITY_CLASSES] = {1200, 50, 20};
+    uint32_t random = 12345;
+    uint16_t used = 0;
+    for (uint32_t ms = 0; ms < 60000; ++ms) {
+        if (ms % 25 == 0 && used > 0) {
+            used -= size;
+        }
+        for (uint8_t cls = 0; cls < PRIORITY_CLASSES; ++cls) {
+            random = random * 1103515245 + 12345;
+            if ((random >> 8) % 10000 >= rate[cls]) {
+                continue;
+            }
+            ++sent[cls];
+            if (!policy.admit(cls, size, used, capacity) || used + size > capacity) {
+                ++lost[cls];
+            } else {
+                used += size;
+            }
+        }
+    }
+}
+
+static void shedding()
+{
+    PriorityPolicy policy;
+    uint16_t sent[PRIORITY_CLASSES] = {};
+    uint16_t lost[PRIORITY_CLASSES] = {};
+    overload(policy, sent, lost);
+    CHECK(lost[2] > 0);
+
+    policy.setShare(2, 30);
+    policy.setShare(1, 10);
+    uint16_t shed[PRIORITY_CLASSES] = {};
+    uint16_t again[PRIORITY_CLASSES] = {};
+    overload(policy, again, shed);
+    CHECK_EQUAL(shed[2], 0);
+    CHECK(shed[1] < lost[1]);
+    CHECK(shed[0] > lost[0]);
+}
+
+int main()
+{
+    rules();
+    shares();
+    shedding();
+    return checkResult();
+}
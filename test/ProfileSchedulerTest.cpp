@@ -0,0 +1,216 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+// Profile switching: the calibration of each profile starts from the FSCAL settings of its image,
+// and is restored as it was by switchProfile(). Then the scheduler on mixed traffic: the dwell
+// follows the packets, the statistics count them, and no packet is cut by a switch.
+
+#include "RadioTest.h"
+#include "ProfileScheduler.h"
+
+const RadioProfile home = RadioProfile::defaults().frequency(868.3f);
+// VCO high core and no charge pump calibration, unlike the reset values
+const RadioProfile other = RadioProfile::defaults().frequency(869.525f).bitrate(100.0f)
+        .set(CC1101_REG_FSCAL3, CC1101_CHP_CURR_CAL_OFF, 5, 4)
+        .set(CC1101_REG_FSCAL2, CC1101_VCO_CORE_HIGH, 5, 5);
+const RadioProfile third = RadioProfile::defaults().frequency(433.92f).bitrate(4.8f);
+
+// FSCAL3[5:4] and FSCAL2[5] are settings, the rest calibration results
+static void checkSettings(const char *name, const uint8_t fscal[3], const RadioProfile &profile)
+{
+    if ((fscal[0] & 0x30) != (profile.regs[CC1101_REG_FSCAL3] & 0x30) ||
+        (fscal[1] & 0x20) != (profile.regs[CC1101_REG_FSCAL2] & 0x20)) {
+        fprintf(stderr, "%s: FSCAL3 %02x FSCAL2 %02x, the profile has %02x %02x\n", name, fscal[0], fscal[1],
+                profile.regs[CC1101_REG_FSCAL3], profile.regs[CC1101_REG_FSCAL2]);
+        ++checkFailures;
+    }
+}
+
+static void calibration()
+{
+    startReceiver(home);
+    radio.setFastHopping(true);
+
+    uint8_t homeCal[3];
+    uint8_t otherCal[3];
+    radio.calibrateProfile(home, homeCal);
+    checkSettings("home", homeCal, home);
+    // charge pump calibrated: the result is the low nibble
+    CHECK_EQUAL(homeCal[0] & 0x0f, chip.regs[CC1101_REG_FSCAL3] & 0x0f);
+    radio.calibrateProfile(other, otherCal);
+    checkSettings("other", otherCal, other);
+    CHECK(memcmp(homeCal, otherCal, 3) != 0);
+
+    // a switch restores the calibration as it was, without calibrating
+    long calibrations = chip.calibrations;
+    radio.switchProfile(home, homeCal);
+    CHECK(memcmp(&chip.regs[CC1101_REG_FSCAL3], homeCal, 3) == 0);
+    CHECK(chip.regs[CC1101_REG_FREQ2] == home.regs[CC1101_REG_FREQ2] &&
+          chip.regs[CC1101_REG_FREQ0] == home.regs[CC1101_REG_FREQ0]);
+    radio.switchProfile(other, otherCal);
+    CHECK(memcmp(&chip.regs[CC1101_REG_FSCAL3], otherCal, 3) == 0);
+    CHECK_EQUAL(chip.calibrations, calibrations);
+    CHECK(chip.receiving());
+}
+
+static void scheduler()
+{
+    startReceiver(home);
+    ProfileScheduler scheduler(radio);
+    scheduler.setHome(&home);
+    CHECK(scheduler.add(&other));
+    CHECK(scheduler.add(&third));
+    scheduler.start();
+    CHECK(scheduler.active());
+
+    // slots go round, packets keep arriving on the profile tuned in
+    for (int i = 0; i < 20; ++i) {
+        chip.advance(ProfileScheduler::MAX_DWELL_MS * 1000UL);
+        scheduler.poll();
+        receivePacket(packet(10, i));
+    }
+    CHECK_EQUAL(received.size(), 20);
+
+    scheduler.stop();
+    CHECK(!scheduler.active());
+    CHECK(chip.regs[CC1101_REG_FREQ1] == home.regs[CC1101_REG_FREQ1] &&
+          chip.regs[CC1101_REG_FREQ0] == home.regs[CC1101_REG_FREQ0]);
+    uint8_t fscal[3];
+    radio.SPIreadRegisterBurst(CC1101_REG_FSCAL3, 3, fscal);
+    checkSettings("stop", fscal, home);
+    CHECK_EQUAL(chip.regs[CC1101_REG_MCSM0] & 0x30, CC1101_FS_AUTOCAL_IDLE_TO_RXTX);
+    chip.advance(1000);
+    CHECK(chip.receiving());
+}
+
+static ProfileScheduler mixed(radio);
+static const RadioProfile *const mixedProfiles[] = {&home, &other, &third};
+
+static void countPacket(const ReadStatus &status)
+{
+    completePacket(status);
+    if (status.errc == ReadErrCode::Ok) {
+        mixed.packetReceived();
+    }
+}
+
+// The profile the radio is tuned to, -1 if none
+static int tuned()
+{
+    for (int i = 0; i < 3; ++i) {
+        const uint8_t *regs = mixedProfiles[i]->regs;
+        if (chip.regs[CC1101_REG_FREQ2] == regs[CC1101_REG_FREQ2] && chip.regs[CC1101_REG_FREQ1] == regs[CC1101_REG_FREQ1] &&
+            chip.regs[CC1101_REG_FREQ0] == regs[CC1101_REG_FREQ0]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// One line of +PROF statistics
+struct ProfileStats {
+    unsigned dwell, slots, hits, deferred, packets;
+};
+
+static std::vector<ProfileStats> profileStats()
+{
+    Serial.output.clear();
+    mixed.printStats();
+    std::vector<ProfileStats> stats;
+    size_t pos = 0;
+    while ((pos = Serial.output.find("+PROF", pos)) != std::string::npos) {
+        ProfileStats line;
+        unsigned index, switchUs;
+        char freq[8];
+        int fields = sscanf(&Serial.output[pos], "+PROF p=%u,freq=%7[0-9A-F],dwell=%u,slots=%u,hits=%u,defer=%u,switch_us=%u,pkts=%u",
+                            &index, freq, &line.dwell, &line.slots, &line.hits, &line.deferred, &switchUs, &line.packets);
+        CHECK_EQUAL(fields, 8);
+        stats.push_back(line);
+        ++pos;
+    }
+    return stats;
+}
+
+static void mixedTraffic()
+{
+    startReceiver(home);
+    radio.setReceiveHandlers(allocatePacket, countPacket);
+    mixed.setHome(&home);
+    mixed.clear();
+    for (const RadioProfile *profile : mixedProfiles) {
+        CHECK(mixed.add(profile));
+    }
+    mixed.start();
+
+    // A 30 bytes packet every 25 ms on the home profile, every 300 ms on the second, nothing on the
+    // third. A packet takes 6.6 ms at 200 us a byte, loop() polls the scheduler every millisecond.
+    const unsigned long periodMs[] = {25, 300, 0};
+    unsigned long tunedMs[3] = {};
+    size_t sent = 0;
+    int cut = 0;
+    unsigned long startMs = millis();
+    for (unsigned long ms = 1; ms <= 20000; ++ms) {
+        chip.advance(1000);
+        mixed.poll();
+        int profile = tuned();
+        CHECK(profile >= 0);
+        if (profile < 0) {
+            break;
+        }
+        ++tunedMs[profile];
+        if (periodMs[profile] == 0 || (millis() - startMs) % periodMs[profile] != 0) {
+            continue;
+        }
+
+        Bytes bytes = packet(30, sent);
+        ++sent;
+        chip.startPacket();
+        for (size_t i = 0; i < bytes.size(); ++i) {
+            feed(&bytes[i], 1, 200);
+            if (i % 5 == 4) {
+                mixed.poll();
+                if (tuned() != profile) {
+                    ++cut;
+                }
+            }
+        }
+        endPacket();
+        ms += bytes.size() * 200 / 1000;
+    }
+    CHECK_EQUAL(cut, 0);
+    CHECK_EQUAL(received.size(), sent);
+    CHECK(failed.empty());
+
+    std::vector<ProfileStats> stats = profileStats();
+    CHECK_EQUAL(stats.size(), 3);
+    if (stats.size() != 3) {
+        return;
+    }
+    // the busy profile at the longest dwell, the quiet ones at the shortest, yet never skipped
+    CHECK_EQUAL(stats[0].dwell, ProfileScheduler::MAX_DWELL_MS);
+    CHECK_EQUAL(stats[2].dwell, ProfileScheduler::MIN_DWELL_MS);
+    CHECK(tunedMs[0] > 2 * (tunedMs[1] + tunedMs[2]));
+    CHECK(stats[1].slots > 20 && stats[2].slots > 20);
+    // every packet counted on its profile, the busy one hits every slot
+    CHECK_EQUAL(stats[0].packets + stats[1].packets, sent);
+    CHECK(stats[1].packets > 0);
+    CHECK_EQUAL(stats[2].packets, 0);
+    CHECK_EQUAL(stats[2].hits, 0);
+    CHECK(stats[0].hits + 1 >= stats[0].slots);
+    CHECK(stats[1].hits > 0 && stats[1].hits < stats[1].slots);
+    // slots of the busy profile ending on a packet waited for it
+    CHECK(stats[0].deferred > 0);
+    printf("mixed traffic: %zu packets, %lu/%lu/%lu ms per profile, %u switches deferred\n",
+           sent, tunedMs[0], tunedMs[1], tunedMs[2], stats[0].deferred);
+
+    mixed.stop();
+}
+
+int main()
+{
+    calibration();
+    scheduler();
+    mixedTraffic();
+    return checkResult();
+}
@@ -0,0 +1,56 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+// Field extraction of the protocol layouts: predicates, byte order, and packets too short for them.
+
+#include <string.h>
+#include "Check.h"
+#include "ProtocolLayout.h"
+
+using Meter = Protocol<1, ByteIs<0, 0x44, 0xfd>, Field<1, 2>, Field<3, 4, Endian::Big>>;
+using Short = Protocol<2, All<ByteIs<0, 0x10>, LengthIn<3, 5>>, Field<2, 1>>;
+using Protocols = ProtocolSet<Meter, Short>;
+
+static_assert(Meter::minLength == 7 && Meter::recordSize == 8, "Meter layout");
+static_assert(Short::minLength == 3 && Short::recordSize == 2, "Short layout");
+
+static void fields()
+{
+    uint8_t payload[] = {0x46, 0x34, 0x12, 0xa1, 0xa2, 0xa3, 0xa4, 0xff};
+    uint8_t record[PROTOCOL_MAX_RECORD];
+    uint8_t id = 0;
+
+    // masked first byte, little endian then big endian field
+    CHECK_EQUAL(Protocols::extract(payload, sizeof(payload), record, id), 8);
+    CHECK_EQUAL(id, 1);
+    const uint8_t expected[] = {2, 0x12, 0x34, 4, 0xa1, 0xa2, 0xa3, 0xa4};
+    CHECK(memcmp(record, expected, sizeof(expected)) == 0);
+
+    // too short for the fields
+    CHECK_EQUAL(Meter::extract(payload, 6, record), 0);
+
+    payload[0] = 0x45;
+    CHECK_EQUAL(Meter::extract(payload, sizeof(payload), record), 0);
+}
+
+static void predicates()
+{
+    uint8_t payload[] = {0x10, 0x00, 0x77, 0x00, 0x00, 0x00};
+    uint8_t record[PROTOCOL_MAX_RECORD];
+    uint8_t id = 0;
+
+    CHECK_EQUAL(Protocols::extract(payload, 5, record, id), 2);
+    CHECK_EQUAL(id, 2);
+    CHECK_EQUAL(record[0], 1);
+    CHECK_EQUAL(record[1], 0x77);
+    CHECK_EQUAL(Protocols::extract(payload, 6, record, id), 0);
+    CHECK_EQUAL(Protocols::extract(payload, 2, record, id), 0);
+}
+
+int main()
+{
+    fields();
+    predicates();
+    return checkResult();
+}
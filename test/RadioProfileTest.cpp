@@ -0,0 +1,112 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+// The register image of a RadioProfile must match what the CC1101Tranceiver setters write.
+
+#include "Check.h"
+#include "ChipMock.h"
+#include "RadioProfile.h"
+
+CC1101Tranceiver radio(ChipMock::CsPin, ChipMock::Gdo0Pin, ChipMock::Gdo2Pin);
+
+// the calibration results are left to the chip
+static bool calibrated(uint8_t reg)
+{
+    return reg >= CC1101_REG_FSCAL3 && reg <= CC1101_REG_FSCAL1;
+}
+
+static void checkImage(const char *name, const RadioProfile &profile)
+{
+    radio.flushRegisters();
+    for (uint8_t reg = 0; reg < RadioProfile::NumRegisters; ++reg) {
+        if (!calibrated(reg) && chip.regs[reg] != profile.regs[reg]) {
+            fprintf(stderr, "%s: register %02x is %02x, the profile has %02x\n", name, reg, chip.regs[reg],
+                    profile.regs[reg]);
+            ++checkFailures;
+        }
+    }
+}
+
+// Configuration of initialize() before the profiles, from the reset values
+static void setDefaults()
+{
+    const RadioProfile reset = RadioProfile::resetValues();
+    radio.SPIwriteRegisterBurst(CC1101_REG_IOCFG2, reset.regs, RadioProfile::NumRegisters);
+    radio.SPIsetRegValue(CC1101_REG_MCSM0, CC1101_FS_AUTOCAL_IDLE_TO_RXTX, 5, 4);
+    radio.SPIsetRegValue(CC1101_REG_PKTCTRL1, CC1101_CRC_AUTOFLUSH_OFF | CC1101_APPEND_STATUS_ON | CC1101_ADR_CHK_NONE, 3, 0);
+    radio.SPIsetRegValue(CC1101_REG_PKTCTRL0, CC1101_WHITE_DATA_OFF | CC1101_PKT_FORMAT_NORMAL, 6, 4);
+    radio.SPIsetRegValue(CC1101_REG_PKTCTRL0, CC1101_CRC_ON | CC1101_LENGTH_CONFIG_VARIABLE, 2, 0);
+    radio.SPIsetRegValue(CC1101_REG_FIFOTHR, CC1101_FIFO_THR_TX_33_RX_32, 3, 0);
+    radio.setFrequency(868.3f);
+    radio.setBitrate(38.4f);
+    radio.setReceiverBW(200.0f);
+    radio.setDeviation(20.0f);
+    radio.setModulation(CC1101Tranceiver::Modulation::FSK2);
+    radio.setVariablePacketLength();
+    radio.setMaximumPacketLength(255);
+    radio.setPreambleLength(CC1101Tranceiver::PreambleTypes::Bytes2);
+    radio.setSyncWord(0x12, 0xAD);
+}
+
+int main()
+{
+    CHECK_EQUAL(radio.initialize(), 0);
+    setDefaults();
+    checkImage("defaults", RadioProfile::defaults());
+
+    radio.setBitrate(38.383f);
+    radio.setDeviation(20.63f);
+    radio.setReceiverBW(101.56f);
+    radio.setModulation(CC1101Tranceiver::Modulation::GFSK);
+    radio.setSyncType(CC1101Tranceiver::SyncType::Sync30_32);
+    radio.setPreambleLength(CC1101Tranceiver::PreambleTypes::Bytes4);
+    radio.setSyncWord(0x2d, 0xc5);
+    radio.enableCRC();
+    radio.enableWhitening();
+    radio.SPIsetRegValue(CC1101_REG_FSCTRL1, 0x06, 4, 0);
+    radio.SPIsetRegValue(CC1101_REG_FSCTRL0, 0x05, 7, 0);
+    constexpr RadioProfile profile = RadioProfile::defaults()
+            .bitrate(38.383f)
+            .deviation(20.63f)
+            .receiverBW(101.56f)
+            .modulation(CC1101Tranceiver::Modulation::GFSK)
+            .syncType(CC1101Tranceiver::SyncType::Sync30_32)
+            .preambleLength(CC1101Tranceiver::PreambleTypes::Bytes4)
+            .syncWord(0x2d, 0xc5)
+            .crc(true)
+            .whitening(true)
+            .set(CC1101_REG_FSCTRL1, 0x06, 4, 0)
+            .set(CC1101_REG_FSCTRL0, 0x05, 7, 0);
+    checkImage("profile", profile);
+
+    for (float freq : {315.0f, 433.92f, 868.95f, 915.0f}) {
+        radio.setFrequency(freq);
+        checkImage("frequency", profile.frequency(freq));
+    }
+    radio.setFrequency(868.3f);
+
+    RadioProfile current = profile;
+    for (float br : {1.2f, 4.8f, 9.6f, 50.0f, 100.0f, 250.0f, 500.0f}) {
+        radio.setBitrate(br);
+        current = current.bitrate(br);
+        checkImage("bitrate", current);
+    }
+    for (float dev : {2.4f, 5.0f, 25.4f, 47.6f, 100.0f, 380.0f}) {
+        radio.setDeviation(dev);
+        current = current.deviation(dev);
+        checkImage("deviation", current);
+    }
+    for (float bw : {58.0f, 68.0f, 81.0f, 101.56f, 162.0f, 325.0f, 406.0f, 541.0f, 650.0f, 812.0f}) {
+        radio.setReceiverBW(bw);
+        current = current.receiverBW(bw);
+        checkImage("bandwidth", current);
+    }
+
+    // a profile applied in one burst lands as it is
+    chip.reset();
+    CHECK_EQUAL(radio.initialize(profile), 0);
+    checkImage("initialize", profile);
+
+    return checkResult();
+}
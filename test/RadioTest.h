@@ -0,0 +1,119 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+#ifndef CCSNIFFER_RADIOTEST_H
+#define CCSNIFFER_RADIOTEST_H
+
+// Packets over the air for the radio tests. The bytes reach the chip mock one at a time and the
+// interrupt handlers run on the edges of GDO2 and GDO0, as main.cpp wires them on the boards.
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include "Check.h"
+#include "ChipMock.h"
+#include "RadioProfile.h"
+#include "cc1101.h"
+
+typedef std::vector<uint8_t> Bytes;
+
+static CC1101Tranceiver radio(ChipMock::CsPin, ChipMock::Gdo0Pin, ChipMock::Gdo2Pin);
+
+// Completed packets, as the FIFO bytes (length, payload, RSSI, LQI), and the other completions
+static std::vector<Bytes> received;
+static std::vector<ReadErrCode> failed;
+static bool allocatorFull = false;
+
+static uint8_t rxBuffers[4][CC1101_MAX_PACKET_LENGTH + 3];
+static uint8_t rxNextBuffer = 0;
+static std::deque<uint8_t *> rxAllocated;
+
+static inline uint8_t *allocatePacket(uint16_t)
+{
+    uint8_t *buffer = allocatorFull ? nullptr : rxBuffers[rxNextBuffer++ % 4];
+    rxAllocated.push_back(buffer);
+    return buffer;
+}
+
+static inline void completePacket(const ReadStatus &status)
+{
+    // a buffer was requested once the length byte was in
+    uint8_t *buffer = nullptr;
+    if (status.len > 0) {
+        buffer = rxAllocated.front();
+        rxAllocated.pop_front();
+    }
+    if (status.errc == ReadErrCode::Ok) {
+        received.push_back(Bytes(buffer, buffer + status.len));
+    } else {
+        failed.push_back(status.errc);
+    }
+}
+
+static inline void clearReceived()
+{
+    received.clear();
+    failed.clear();
+}
+
+// Radio set up like setup() in main.cpp, listening
+static inline void startReceiver(const RadioProfile &profile = RadioProfile::defaults())
+{
+    chip.reset();
+    clearReceived();
+    rxAllocated.clear();
+    radio.initialize(profile);
+    radio.setReceiveHandlers(allocatePacket, completePacket);
+    radio.setContinuousReceive(true);
+    radio.setReceiveHandler(nullptr, CC1101Tranceiver::SignalDirection::Change);
+    radio.setFifoHandler(nullptr, CC1101Tranceiver::SignalDirection::Rising);
+    radio.receive();
+    // through the calibration and the settling
+    chip.advance(1000);
+}
+
+// The bytes of a variable length packet in the FIFO: length, payload, RSSI and LQI with CRC ok
+static inline Bytes packet(uint8_t len, uint8_t seed)
+{
+    Bytes bytes;
+    bytes.push_back(len);
+    for (uint8_t i = 0; i < len; ++i) {
+        bytes.push_back(seed + i);
+    }
+    bytes.push_back(0x40);
+    bytes.push_back(0x80);
+    return bytes;
+}
+
+// Feeds the bytes with the FIFO threshold interrupt, byteUs apart
+static inline void feed(const uint8_t *data, size_t len, unsigned long byteUs = 0)
+{
+    for (size_t i = 0; i < len; ++i) {
+        bool above = chip.gdo2();
+        chip.receiveBytes(&data[i], 1);
+        if (!above && chip.gdo2()) {
+            radio.drainFifo();
+        }
+        chip.advance(byteUs);
+    }
+}
+
+// The end of the packet, with its interrupt if GDO0 falls
+static inline void endPacket(bool discarded = false)
+{
+    bool sync = chip.gdo0();
+    chip.endPacket(discarded);
+    if (sync && !chip.gdo0()) {
+        radio.endReceive();
+    }
+}
+
+static inline void receivePacket(const Bytes &bytes, unsigned long byteUs = 0)
+{
+    chip.startPacket();
+    feed(bytes.data(), bytes.size(), byteUs);
+    endPacket();
+}
+
+#endif //CCSNIFFER_RADIOTEST_H
@@ -0,0 +1,130 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+// Shadow of the configuration registers: masked updates and reads stay in the shadow, the dirty
+// registers go out in bursts before the next strobe, and the chip ends up with the same image.
+
+#include <initializer_list>
+#include "RadioTest.h"
+
+// Every shadowed register reads back from the chip as the driver sees it
+static void checkImage()
+{
+    for (uint8_t reg = 0; reg <= CC1101_REG_TEST0; ++reg) {
+        if (reg >= CC1101_REG_FSCAL3 && reg <= CC1101_REG_FSCAL1) {
+            continue;
+        }
+        uint8_t value = radio.SPIgetRegValue(reg);
+        if (chip.regs[reg] != value) {
+            fprintf(stderr, "register %02x: chip %02x, shadow %02x\n", reg, chip.regs[reg], value);
+            ++checkFailures;
+        }
+    }
+}
+
+static void reads()
+{
+    startReceiver();
+    long transactions = chip.transactions;
+    checkImage();
+    CHECK_EQUAL(chip.transactions, transactions);
+
+    // the calibration results come from the chip
+    chip.regs[CC1101_REG_FSCAL1] = 0x21;
+    CHECK_EQUAL(radio.SPIgetRegValue(CC1101_REG_FSCAL1), 0x21);
+    CHECK_EQUAL(chip.transactions, transactions + 1);
+}
+
+static void deferredWrites()
+{
+    startReceiver();
+    radio.standby();
+    long transactions = chip.transactions;
+    uint8_t before = chip.regs[CC1101_REG_FREQ1];
+    radio.SPIsetRegValue(CC1101_REG_FREQ1, 0x42, 6, 1);
+    radio.SPIsetRegValue(CC1101_REG_FREQ1, 0x00, 0, 0);
+    CHECK_EQUAL(chip.transactions, transactions);
+    CHECK_EQUAL(chip.regs[CC1101_REG_FREQ1], before);
+    CHECK_EQUAL(radio.SPIgetRegValue(CC1101_REG_FREQ1, 6, 1), 0x42);
+
+    // the next strobe writes it out first
+    radio.standby();
+    CHECK_EQUAL(chip.transactions, transactions + 2);
+    CHECK_EQUAL(chip.regs[CC1101_REG_FREQ1], (before & 0x80) | 0x42);
+    checkImage();
+}
+
+// Changes a bit of every register
+static void touch(std::initializer_list<uint8_t> regs)
+{
+    for (uint8_t reg : regs) {
+        radio.SPIsetRegValue(reg, radio.SPIgetRegValue(reg) ^ 0x01);
+    }
+}
+
+static void bursts()
+{
+    startReceiver();
+    radio.standby();
+
+    // a burst carries on over two clean registers
+    long transactions = chip.transactions;
+    touch({CC1101_REG_FREQ2, CC1101_REG_MDMCFG4});
+    radio.flushRegisters();
+    CHECK_EQUAL(chip.transactions, transactions + 1);
+
+    // but not over three
+    transactions = chip.transactions;
+    touch({CC1101_REG_FREQ2, CC1101_REG_MDMCFG3});
+    radio.flushRegisters();
+    CHECK_EQUAL(chip.transactions, transactions + 2);
+
+    // nor over the calibration results
+    transactions = chip.transactions;
+    touch({CC1101_REG_FREND0, CC1101_REG_FSCAL0});
+    radio.flushRegisters();
+    CHECK_EQUAL(chip.transactions, transactions + 2);
+    checkImage();
+}
+
+static void setters()
+{
+    // A profile set up with the setters: every setter strobes IDLE, which first writes the
+    // registers of the setter before in one burst
+    startReceiver();
+    radio.standby();
+    long transactions = chip.transactions;
+    radio.setFrequency(433.92f);
+    radio.setBitrate(4.8f);
+    radio.setDeviation(5.157f);
+    radio.setReceiverBW(58.0f);
+    radio.setModulation(CC1101Tranceiver::Modulation::FSK2);
+    radio.setSyncWord(0xd3, 0x91);
+    radio.flushRegisters();
+    CHECK_EQUAL(chip.transactions - transactions, 13);
+    checkImage();
+
+    const RadioProfile fsk433 = RadioProfile::defaults()
+            .frequency(433.92f)
+            .bitrate(4.8f)
+            .deviation(5.157f)
+            .receiverBW(58.0f)
+            .modulation(CC1101Tranceiver::Modulation::FSK2)
+            .syncWord(0xd3, 0x91);
+    for (uint8_t reg = CC1101_REG_FIFOTHR; reg < CC1101_REG_FSCAL3; ++reg) {
+        if (reg != CC1101_REG_MCSM1 && reg != CC1101_REG_MCSM0 && chip.regs[reg] != fsk433.regs[reg]) {
+            fprintf(stderr, "register %02x: chip %02x, profile %02x\n", reg, chip.regs[reg], fsk433.regs[reg]);
+            ++checkFailures;
+        }
+    }
+}
+
+int main()
+{
+    reads();
+    deferredWrites();
+    bursts();
+    setters();
+    return checkResult();
+}
@@ -0,0 +1,120 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+// SPI transactions of the receive path: the status byte of each burst tells the state and the FIFO
+// bytes, so that RXBYTES is only read when nothing else gives the count. On the ESP32 every
+// transaction but the strobes is a single block transfer.
+
+#include "RadioTest.h"
+
+static long receiveTransactions(uint8_t len)
+{
+    Bytes bytes = packet(len, len);
+    long transactions = chip.transactions;
+    receivePacket(bytes, 200);
+    CHECK(!received.empty() && received.back() == bytes);
+    return chip.transactions - transactions;
+}
+
+static void perPacket()
+{
+    startReceiver();
+    // length byte and payload at the end, plus a burst per threshold before that
+    CHECK_EQUAL(receiveTransactions(10), 2);
+    CHECK_EQUAL(receiveTransactions(60), 4);
+    CHECK_EQUAL(receiveTransactions(200), 9);
+    CHECK(failed.empty());
+}
+
+// Packet b is in before the end of packet interrupt of a is served
+static long packetsBehind(uint8_t lenA, uint8_t lenB)
+{
+    Bytes a = packet(lenA, 1);
+    Bytes b = packet(lenB, 2);
+    chip.startPacket();
+    chip.receiveBytes(a.data(), a.size());
+    chip.endPacket();
+    chip.startPacket();
+    chip.receiveBytes(b.data(), b.size());
+    long transactions = chip.transactions;
+    size_t count = received.size();
+    endPacket();
+    CHECK_EQUAL(received.size(), count + 2);
+    CHECK(received.size() == count + 2 && received[count] == a && received[count + 1] == b);
+    CHECK(chip.rx.empty());
+    return chip.transactions - transactions;
+}
+
+static void queuedPackets()
+{
+    startReceiver();
+    // the status byte of the last burst of a counts the bytes of b
+    CHECK_EQUAL(packetsBehind(4, 2), 4);
+    // it saturates at 15, RXBYTES gives the count
+    CHECK_EQUAL(packetsBehind(6, 4), 5);
+    CHECK(failed.empty());
+}
+
+// Sends the packet with the FIFO handler, returns the bytes that went over the air
+static Bytes transmit(const Bytes &payload)
+{
+    Bytes air;
+    CHECK(radio.startTransmit(payload.data(), payload.size()));
+    chip.advance(1000);
+    bool sending = true;
+    while (sending) {
+        size_t queued = chip.tx.size();
+        uint8_t next = queued > 0 ? chip.tx.front() : 0;
+        bool above = chip.gdo2();
+        bool sync = chip.gdo0();
+        sending = chip.transmitByte();
+        if (chip.tx.size() < queued) {
+            air.push_back(next);
+        }
+        if (!above && chip.gdo2()) {
+            radio.refillTransmit();
+        }
+        if (sync && !chip.gdo0()) {
+            CHECK(radio.endTransmit() == TxStatus::Sent);
+        }
+    }
+    return air;
+}
+
+static void blockTransfers()
+{
+    startReceiver();
+    long transactions = chip.transactions - chip.strobes;
+    long blocks = chip.blocks;
+
+    for (uint8_t len : {10, 63, 64, 200, 254}) {
+        Bytes bytes = packet(len, len);
+        receivePacket(bytes, 20);
+        CHECK(!received.empty() && received.back() == bytes);
+
+        Bytes payload(bytes.begin() + 1, bytes.end() - 2);
+        Bytes air = transmit(payload);
+        CHECK_EQUAL(air.size(), payload.size() + 1);
+        CHECK(air.size() == payload.size() + 1 && air[0] == len &&
+              std::equal(payload.begin(), payload.end(), air.begin() + 1));
+        chip.advance(1000);
+    }
+    CHECK(failed.empty());
+
+    transactions = chip.transactions - chip.strobes - transactions;
+#ifdef CC1101_ESP32_SPI
+    // one block per transaction, none carries more than the header and a FIFO
+    CHECK_EQUAL(chip.blocks - blocks, transactions);
+#else
+    CHECK_EQUAL(chip.blocks - blocks, 0);
+#endif
+}
+
+int main()
+{
+    perPacket();
+    queuedPackets();
+    blockTransfers();
+    return checkResult();
+}
@@ -0,0 +1,59 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+// RSSI sweep: the channels stepped through, and the radio put back as the profile wants it after
+// endSweep(), calibration settings included.
+
+#include "RadioTest.h"
+
+// VCO high core, unlike the reset values
+const RadioProfile profile = RadioProfile::defaults().frequency(868.3f).receiverBW(101.56f)
+        .set(CC1101_REG_FSCAL2, CC1101_VCO_CORE_HIGH, 5, 5);
+
+int main()
+{
+    startReceiver(profile);
+    uint8_t iocfg2 = chip.regs[CC1101_REG_IOCFG2];
+    uint8_t iocfg0 = chip.regs[CC1101_REG_IOCFG0];
+
+    const uint8_t steps = 11;
+    CHECK_EQUAL(radio.beginSweep(868.0f, 100.0f, steps), 0);
+    CHECK(radio.channelSpacing() > 99000 && radio.channelSpacing() < 101000);
+    // quiet interrupts
+    CHECK(!chip.gdo0() && !chip.gdo2());
+
+    uint8_t rssi[steps];
+    uint8_t channels[steps];
+    long calibrations = chip.calibrations;
+    for (uint8_t i = 0; i < steps; ++i) {
+        chip.rssi = 0x10 + i;
+        radio.sweep(rssi, i + 1);
+        channels[i] = chip.regs[CC1101_REG_CHANNR];
+    }
+    for (uint8_t i = 0; i < steps; ++i) {
+        CHECK_EQUAL(channels[i], i);
+        CHECK_EQUAL(rssi[i], 0x10 + steps - 1);
+    }
+    // calibrated once in beginSweep()
+    CHECK_EQUAL(chip.calibrations, calibrations);
+
+    radio.endSweep(profile);
+    CHECK_EQUAL(chip.regs[CC1101_REG_IOCFG2], iocfg2);
+    CHECK_EQUAL(chip.regs[CC1101_REG_IOCFG0], iocfg0);
+    CHECK_EQUAL(chip.regs[CC1101_REG_FREQ0], profile.regs[CC1101_REG_FREQ0]);
+    CHECK_EQUAL(chip.regs[CC1101_REG_MCSM0] & 0x30, CC1101_FS_AUTOCAL_IDLE_TO_RXTX);
+    // the calibration settings of the profile, read back from the chip
+    uint8_t fscal2 = radio.SPIreadRegister(CC1101_REG_FSCAL2);
+    uint8_t fscal3 = radio.SPIreadRegister(CC1101_REG_FSCAL3);
+    CHECK_EQUAL(fscal2 & 0x20, CC1101_VCO_CORE_HIGH);
+    CHECK_EQUAL(fscal3 & 0x30, profile.regs[CC1101_REG_FSCAL3] & 0x30);
+
+    chip.advance(1000);
+    CHECK(chip.receiving());
+    Bytes a = packet(20, 3);
+    receivePacket(a);
+    CHECK(received.size() == 1 && received[0] == a);
+
+    return checkResult();
+}
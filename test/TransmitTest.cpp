@@ -0,0 +1,118 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+// Interrupt driven transmit of packets longer than the 64 bytes FIFO: refills on the TX FIFO
+// threshold (GDO2), completion or underflow on the end of packet (GDO0), then back to RX.
+
+#include "RadioTest.h"
+
+static std::vector<TxStatus> ends;
+static int refills = 0;
+
+// The air side of the packet, byteUs apart. The FIFO handler runs on each GDO2 rise, as irqFifo()
+// does while transmitting, unless served is false; irqRead() reports the end when GDO0 falls.
+static Bytes transmit(const Bytes &payload, bool served = true, unsigned long byteUs = 20)
+{
+    Bytes air;
+    CHECK(radio.startTransmit(payload.data(), payload.size()));
+    chip.advance(1000);
+    bool sending = true;
+    while (sending) {
+        size_t queued = chip.tx.size();
+        uint8_t next = queued > 0 ? chip.tx.front() : 0;
+        bool above = chip.gdo2();
+        bool sync = chip.gdo0();
+        sending = chip.transmitByte();
+        if (chip.tx.size() < queued) {
+            air.push_back(next);
+        }
+        if (served && !above && chip.gdo2()) {
+            ++refills;
+            radio.refillTransmit();
+        }
+        if (sync && !chip.gdo0()) {
+            ends.push_back(radio.endTransmit());
+        }
+        chip.advance(byteUs);
+    }
+    return air;
+}
+
+static Bytes payload(uint8_t len, uint8_t seed)
+{
+    Bytes bytes = packet(len, seed);
+    return Bytes(bytes.begin() + 1, bytes.end() - 2);
+}
+
+// Back in RX with the receive interrupts, a packet gets through
+static void checkReceiving()
+{
+    chip.advance(1000);
+    CHECK(!radio.isTransmitting());
+    CHECK(chip.receiving());
+    CHECK(chip.tx.empty());
+    Bytes bytes = packet(100, 7);
+    receivePacket(bytes, 20);
+    CHECK(!received.empty() && received.back() == bytes);
+}
+
+static void longPacket()
+{
+    startReceiver();
+    ends.clear();
+    refills = 0;
+
+    Bytes bytes = payload(CC1101_MAX_PACKET_LENGTH - 1, 3);
+    Bytes air = transmit(bytes);
+
+    // length byte and 63 bytes first, the rest from the threshold interrupts
+    CHECK(refills >= 3);
+    CHECK(air.size() == bytes.size() + 1 && air[0] == bytes.size() &&
+          std::equal(bytes.begin(), bytes.end(), air.begin() + 1));
+    CHECK_EQUAL(ends.size(), 1);
+    CHECK(ends.size() == 1 && ends[0] == TxStatus::Sent);
+    checkReceiving();
+    CHECK(failed.empty());
+}
+
+static void underflow()
+{
+    startReceiver();
+    ends.clear();
+    refills = 0;
+
+    // the threshold interrupt is never served: the FIFO runs dry after its first 64 bytes
+    Bytes bytes = payload(200, 5);
+    Bytes air = transmit(bytes, false);
+
+    CHECK_EQUAL(air.size(), CC1101_FIFO_SIZE);
+    CHECK_EQUAL(ends.size(), 1);
+    CHECK(ends.size() == 1 && ends[0] == TxStatus::Underflow);
+    checkReceiving();
+
+    // the next packet goes out whole
+    ends.clear();
+    air = transmit(bytes);
+    CHECK(ends.size() == 1 && ends[0] == TxStatus::Sent);
+    CHECK_EQUAL(air.size(), bytes.size() + 1);
+    checkReceiving();
+    CHECK(failed.empty());
+}
+
+static void tooLong()
+{
+    startReceiver();
+    Bytes bytes(CC1101_MAX_PACKET_LENGTH, 0x55);
+    CHECK(!radio.startTransmit(bytes.data(), bytes.size()));
+    CHECK(!radio.isTransmitting());
+    CHECK(chip.receiving());
+}
+
+int main()
+{
+    longPacket();
+    underflow();
+    tooLong();
+    return checkResult();
+}
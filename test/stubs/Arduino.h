@@ -0,0 +1,98 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+#ifndef CCSNIFFER_TEST_ARDUINO_H
+#define CCSNIFFER_TEST_ARDUINO_H
+
+// The part of the Arduino core the sources use, for the host tests. Pins, time and SPI are backed
+// by the chip mock in ChipMock.cpp; the serial output is collected in Serial.output.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+class __FlashStringHelper;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+#define HEX 16
+#define DEC 10
+#define MSBFIRST 1
+#define MISO 12
+
+// program memory is plain memory on the host
+#define PROGMEM
+#define F(x) (reinterpret_cast<const __FlashStringHelper *>(x))
+#define PSTR(x) (x)
+#define pgm_read_byte(p) (*reinterpret_cast<const uint8_t *>(p))
+#define pgm_read_word(p) (*reinterpret_cast<const uint16_t *>(p))
+#define pgm_read_ptr(p) (*reinterpret_cast<void * const *>(p))
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+
+#define digitalPinToInterrupt(p) (p)
+
+class HardwareSerial {
+public:
+    std::string output;
+
+    void begin(unsigned long) {}
+    size_t setTxBufferSize(size_t n) { return n; }
+    int available() { return 0; }
+    int read() { return -1; }
+    int availableForWrite() { return 64; }
+    void flush() {}
+    operator bool() { return true; }
+
+    size_t write(uint8_t b) { output += static_cast<char>(b); return 1; }
+    size_t write(const uint8_t *data, size_t n) { output.append(reinterpret_cast<const char *>(data), n); return n; }
+
+    size_t print(const char *s) { output += s; return strlen(s); }
+    size_t print(const __FlashStringHelper *s) { return print(reinterpret_cast<const char *>(s)); }
+    size_t print(char c) { return write(static_cast<uint8_t>(c)); }
+    size_t print(unsigned long n, int base = DEC);
+    size_t print(long n, int base = DEC);
+    size_t print(unsigned int n, int base = DEC) { return print(static_cast<unsigned long>(n), base); }
+    size_t print(int n, int base = DEC) { return print(static_cast<long>(n), base); }
+    size_t print(unsigned char n, int base = DEC) { return print(static_cast<unsigned long>(n), base); }
+    size_t print(double n, int digits = 2);
+
+    size_t println() { return print('\n'); }
+    template<typename T>
+    size_t println(T value) { size_t n = print(value); return n + println(); }
+    template<typename T>
+    size_t println(T value, int format) { size_t n = print(value, format); return n + println(); }
+};
+
+extern HardwareSerial Serial;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+void attachInterrupt(uint8_t interrupt, void (*handler)(), int mode);
+void detachInterrupt(uint8_t interrupt);
+void noInterrupts();
+void interrupts();
+
+#endif //CCSNIFFER_TEST_ARDUINO_H
@@ -0,0 +1,29 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+#ifndef CCSNIFFER_TEST_SPI_H
+#define CCSNIFFER_TEST_SPI_H
+
+#include <Arduino.h>
+
+#define SPI_MODE0 0
+
+struct SPISettings {
+    SPISettings() = default;
+    SPISettings(uint32_t, uint8_t, uint8_t) {}
+};
+
+// Every byte goes to the chip mock; transferBytes() is the ESP32 core block transfer
+class SPIClass {
+public:
+    void begin() {}
+    void beginTransaction(SPISettings) {}
+    void endTransaction() {}
+    uint8_t transfer(uint8_t data);
+    void transferBytes(const uint8_t *out, uint8_t *in, uint32_t size);
+};
+
+extern SPIClass SPI;
+
+#endif //CCSNIFFER_TEST_SPI_H
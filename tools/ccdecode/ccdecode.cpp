@@ -0,0 +1,171 @@
+//
+// Created by happycactus on 17/10/26.
+//
+
+// Host decoder for the binary output of ccSniffer (+BIN), prints the frames in the text format.
+//
+//   g++ -std=c++11 -O2 -o ccdecode tools/ccdecode/ccdecode.cpp
+//   stty -F /dev/ttyUSB0 38400 raw && ./ccdecode < /dev/ttyUSB0
+//
+// Chunks between delimiters that are not valid frames (replies to commands) are printed as they are.
+
+#include <cstdio>
+#include <vector>
+#include "../../src/Frame.h"
+
+namespace {
+
+uint32_t le(const uint8_t *p, int n)
+{
+    uint32_t v = 0;
+    for (int i = n - 1; i >= 0; --i) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+const char *statusSuffix(uint8_t status)
+{
+    return status == 1 ? ",BADCRC" : status == 2 ? ",BADCODE" : "";
+}
+
+void printPacket(const uint8_t *body, int len)
+{
+    if (len < FramePacketHeaderSize - 1) {
+        printf("+DECODE short packet frame\n");
+        return;
+    }
+    uint64_t timestamp = ((uint64_t) le(&body[6], 2) << 32) | le(&body[2], 4);
+    printf("*%u,%llu,%u,%u,", le(&body[0], 2), (unsigned long long) timestamp, body[8], body[9]);
+    for (int i = FramePacketHeaderSize - 1; i < len; ++i) {
+        printf("%02X", body[i]);
+    }
+    if (body[11] > 1) {
+        printf(",x%u:%u", body[11], body[12]);
+    }
+    printf("%s\n", statusSuffix(body[10]));
+}
+
+void printFields(const uint8_t *body, int len)
+{
+    if (len < FramePacketHeaderSize) {
+        printf("+DECODE short fields frame\n");
+        return;
+    }
+    uint64_t timestamp = ((uint64_t) le(&body[6], 2) << 32) | le(&body[2], 4);
+    printf("*%u,%llu,%u,%u,@%u", le(&body[0], 2), (unsigned long long) timestamp, body[8], body[9],
+           body[FramePacketHeaderSize - 1]);
+    int i = FramePacketHeaderSize;
+    while (i < len) {
+        int end = i + 1 + body[i];
+        if (end > len) {
+            printf(",+DECODE bad field\n");
+            return;
+        }
+        printf(",");
+        for (++i; i < end; ++i) {
+            printf("%02X", body[i]);
+        }
+    }
+    if (body[11] > 1) {
+        printf(",x%u:%u", body[11], body[12]);
+    }
+    printf("%s\n", statusSuffix(body[10]));
+}
+
+void printStatus(const uint8_t *body, int len)
+{
+    if (len < 3) {
+        printf("+DECODE short status frame\n");
+        return;
+    }
+    const char *name;
+    switch (static_cast<FrameStatus>(body[0])) {
+        case FrameStatus::Timeout:
+            name = "Timeout";
+            break;
+        case FrameStatus::Overflow:
+            name = "Overflow";
+            break;
+        case FrameStatus::QueueFull:
+            name = "Queue full";
+            break;
+        case FrameStatus::Sent:
+            name = "Sent";
+            break;
+        case FrameStatus::TxUnderflow:
+            name = "TX underflow";
+            break;
+        default:
+            name = "Unknown";
+            break;
+    }
+    printf("+CC1101 %s (%u)\n", name, le(&body[1], 2));
+}
+
+void printSweep(const uint8_t *body, int len)
+{
+    if (len < 7 || len < 7 + body[6]) {
+        printf("+DECODE short sweep frame\n");
+        return;
+    }
+    uint32_t start = le(&body[0], 4);
+    uint32_t step = le(&body[4], 2) * 10;
+    printf("#%u,%u", start, step);
+    for (int i = 0; i < body[6]; ++i) {
+        printf(",%.1f", static_cast<int8_t>(body[7 + i]) / 2.0 - 74);
+    }
+    printf("\n");
+}
+
+void decode(const std::vector<uint8_t> &chunk)
+{
+    if (chunk.empty()) {
+        return;
+    }
+
+    std::vector<uint8_t> frame(chunk.size());
+    int len = readFrame(chunk.data(), chunk.size(), frame.data(), frame.size());
+    if (len < 0) {
+        fwrite(chunk.data(), 1, chunk.size(), stdout);
+        return;
+    }
+
+    const uint8_t *body = &frame[1];
+    switch (static_cast<FrameType>(frame[0])) {
+        case FrameType::Packet:
+            printPacket(body, len - 1);
+            break;
+        case FrameType::Status:
+            printStatus(body, len - 1);
+            break;
+        case FrameType::Sweep:
+            printSweep(body, len - 1);
+            break;
+        case FrameType::Fields:
+            printFields(body, len - 1);
+            break;
+        default:
+            printf("+DECODE unknown frame type %u\n", frame[0]);
+            break;
+    }
+}
+
+}
+
+int main()
+{
+    std::vector<uint8_t> chunk;
+    int c;
+    while ((c = getchar()) != EOF) {
+        if (c == 0) {
+            decode(chunk);
+            chunk.clear();
+            fflush(stdout);
+        } else {
+            chunk.push_back(c);
+        }
+    }
+    decode(chunk);
+    return 0;
+}